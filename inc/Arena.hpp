@@ -0,0 +1,152 @@
+#pragma once
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @class ObjectPool
+ * @brief A slab pool owning every object of one type in a graph.
+ *
+ * Objects are constructed in contiguous chunks whose size doubles up to a
+ * limit, and are only released all together when the pool is cleared or
+ * destroyed.
+ */
+template <typename T>
+class ObjectPool
+{
+private:
+    struct Slot
+    {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+    struct Chunk
+    {
+        std::unique_ptr<Slot[]> slots;
+        size_t capacity;
+        size_t used;
+    };
+
+    static constexpr size_t firstChunkSize = 64;
+    static constexpr size_t maxChunkSize = 65536;
+
+    std::vector<Chunk> chunks;
+    size_t numObjects = 0;
+
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+    ~ObjectPool() { clear(); }
+
+    /**
+     * @brief Constructs a new object in the pool.
+     * @param args The arguments forwarded to the constructor of T.
+     * @return A pointer to the object, valid until the pool is cleared.
+     */
+    template <typename... Args>
+    T *create(Args &&...args)
+    {
+        if (chunks.empty() || chunks.back().used == chunks.back().capacity)
+        {
+            size_t capacity = chunks.empty() ? firstChunkSize : std::min(2 * chunks.back().capacity, maxChunkSize);
+            chunks.push_back(Chunk{std::unique_ptr<Slot[]>(new Slot[capacity]), capacity, 0});
+        }
+        Chunk &chunk = chunks.back();
+        T *object = new (chunk.slots[chunk.used].bytes) T(std::forward<Args>(args)...);
+        chunk.used++;
+        numObjects++;
+        return object;
+    }
+
+    /**
+     * @brief Default-constructs count objects in one contiguous chunk of their own.
+     * @param count The number of objects.
+     * @return A pointer to the first object, the others following it, valid until the pool is cleared.
+     */
+    T *createBlock(size_t count)
+    {
+        if (count == 0)
+            return nullptr;
+        // the chunk goes before the one being filled, so create() keeps filling that one
+        Chunk block{std::unique_ptr<Slot[]>(new Slot[count]), count, 0};
+        for (; block.used < count; block.used++)
+        {
+            new (block.slots[block.used].bytes) T();
+        }
+        numObjects += count;
+        T *first = std::launder(reinterpret_cast<T *>(block.slots[0].bytes));
+        chunks.insert(chunks.empty() ? chunks.end() : chunks.end() - 1, std::move(block));
+        return first;
+    }
+
+    /**
+     * @brief Destroys every object of the pool and releases its memory.
+     */
+    void clear()
+    {
+        if constexpr (!std::is_trivially_destructible_v<T>)
+        {
+            for (auto &chunk : chunks)
+            {
+                for (size_t i = 0; i < chunk.used; i++)
+                {
+                    std::launder(reinterpret_cast<T *>(chunk.slots[i].bytes))->~T();
+                }
+            }
+        }
+        chunks.clear();
+        numObjects = 0;
+    }
+
+    /**
+     * @brief The number of objects created in the pool.
+     */
+    size_t size() const { return numObjects; }
+
+    /**
+     * @brief The number of bytes reserved by the chunks of the pool.
+     */
+    size_t bytesAllocated() const
+    {
+        size_t bytes = 0;
+        for (auto &chunk : chunks)
+        {
+            bytes += chunk.capacity * sizeof(Slot);
+        }
+        return bytes;
+    }
+};
+
+/**
+ * @struct GraphArena
+ * @brief The pools owning all the objects of a TPG or BTPG.
+ */
+struct GraphArena
+{
+    ObjectPool<Node> nodes;
+    ObjectPool<Agent> agents;
+    ObjectPool<type2Edge> type2Edges;
+    ObjectPool<Type2EdgeGroup> type2EdgeGroups;
+    ObjectPool<BiPair> biPairs;
+    ObjectPool<BiGroupPair> biGroupPairs;
+
+    /**
+     * @brief Prints the number of objects and the bytes allocated for each object type.
+     * @param os The stream to print to.
+     */
+    void report(std::ostream &os) const
+    {
+        os << "******** Memory Info ********" << std::endl;
+        os << "Node: " << nodes.size() << " objects, " << nodes.bytesAllocated() << " bytes" << std::endl;
+        os << "Agent: " << agents.size() << " objects, " << agents.bytesAllocated() << " bytes" << std::endl;
+        os << "type2Edge: " << type2Edges.size() << " objects, " << type2Edges.bytesAllocated() << " bytes" << std::endl;
+        os << "Type2EdgeGroup: " << type2EdgeGroups.size() << " objects, " << type2EdgeGroups.bytesAllocated() << " bytes" << std::endl;
+        os << "BiPair: " << biPairs.size() << " objects, " << biPairs.bytesAllocated() << " bytes" << std::endl;
+        os << "BiGroupPair: " << biGroupPairs.size() << " objects, " << biGroupPairs.bytesAllocated() << " bytes" << std::endl;
+    }
+};
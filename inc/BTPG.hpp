@@ -1,9 +1,27 @@
 #pragma once
 #include "TPG.hpp"
+#include "SearchScratch.hpp"
+#include "ReachIndex.hpp"
 
 #include <set>
 #include <unordered_map>
 #include <chrono>
+#include <cstdint>
+
+/**
+ * @struct SearchOptions
+ * @brief Optional limits and instrumentation of the BiPair search.
+ */
+struct SearchOptions
+{
+    uint64_t maxExpansions = 0;   ///< Node expansions after which a singleton check rejects its candidate, 0 for no limit
+    bool meetInMiddle = true;     ///< True to rule out a cycle with a frontier from each end before the search
+    bool groupReversal = false;   ///< True to also reverse groups of several edges, each as a whole
+    bool prioritize = false;      ///< True to check the candidates by their estimated benefit instead of in group order
+    bool giveUpCancelled = false; ///< True to reject a candidate whose check the deadline stopped in two calls in a row, as at maxExpansions
+    bool collectStats = false;    ///< True to collect the counters of every check and print them at the end of the build
+    std::string statsFile;        ///< JSON file the counters are written to at the end of the build, if not empty
+};
 
 class BTPG : public TPG
 {
@@ -12,24 +30,122 @@ private:
     int mode;
     std::vector<BiPair *> BiPairs;
     std::vector<Type2EdgeGroup *> Type2EdgeGroups;
+    std::vector<BiGroupPair *> BiGroupPairs;
     
 
     int naiveNegativeCase = 0;
+    // progress of the BiPair search, kept between calls to Resume
+    int groupCursor = 0;       ///< next group to check in the current pass
+    int passNewPairs = 0;      ///< singletons and groups that became bidirectional in the current pass
+    int type2EdgeSigleton = 0; ///< singletons checked in the current pass
+    bool groupPass = false;    ///< true once the singletons are done and the groups are checked
+    int pass = 0;              ///< singleton passes done
+    std::vector<int> checkOrder; ///< groups in the order they are checked, empty for group order
+    int cancelledGroup = -1;     ///< group whose check the deadline stopped, checked first by the next call
     // Helpers
-    void CheckSingleton(type2Edge *candidateEdge);
-    bool CheckSingletonValidity(type2Edge *candidateEdge);
-    bool BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &VisitedStack_, std::vector<std::set<Node *>> &RevisitedNodes_, std::vector<Node *> &RecursionPath_, std::set<Node *> &RecursionPathSet_,
-                          std::unordered_map<int, int> &AgentEdgeMap_, std::unordered_map<int, int> &AgentEdgeMapLeave_, bool hasTYpe1Edge_);
+    void GroupType2Edges();
+    void GroupAgentEdges(const FlatGraph &flat, int robotId, std::vector<std::vector<type2Edge *>> &groups);
+    void OrderCandidates();
+    Type2EdgeGroup *GroupAt(int position);
+    bool CheckSingleton(type2Edge *candidateEdge);
+    bool CheckSingletonValidity(SearchScratch &scratch, type2Edge *candidateEdge);
+    bool CheckGroup(Type2EdgeGroup *group);
+    bool CheckGroupValidity(SearchScratch &scratch, Type2EdgeGroup *group);
+    void RecordCheck(type2Edge *candidateEdge, bool valid, bool skipped);
+    type2Edge *ReverseEdge(type2Edge *candidateEdge);
+    void ReverseGroup(Type2EdgeGroup *group);
+    type2Edge *SearchEdge(SearchScratch &scratch, int edgeId);
+    const FlatGraph *flat = nullptr; ///< flat view of the graph during a search
+    SearchScratch scratch;           ///< search state reused by every check
+    ReachIndex reach;                ///< reachability of the graph, to skip searches that cannot reach their end
+    bool reachTried = false;
+    int reachMisses = 0; ///< searches in a row that the reach index could not skip
+    bool ReachesEnd(type2Edge *candidateEdge);
+
+    // Speculative checks of the next singletons, run in parallel against the current graph
+    struct SpeculativeCheck
+    {
+        int edgeId = -1;
+        bool valid = false;
+        bool unreachable = false; ///< decided by the reach index
+        std::vector<int> expanded; ///< nodes whose outgoing edges the check depends on
+        std::vector<int> entered;  ///< nodes whose incoming edges the check depends on
+        SearchStats stats;
+    };
+    int numThreads = 1;
+    std::vector<SearchScratch> workerScratch;
+    std::vector<SpeculativeCheck> speculation;
+    size_t speculationNext = 0;
+    uint32_t speculationRound = 0;
+    std::vector<uint32_t> changedMarks;   ///< speculationRound for the nodes whose outgoing edges changed in the round
+    std::vector<uint32_t> changedInMarks; ///< speculationRound for the nodes whose incoming edges changed in the round
+    void Speculate();
+
+    // Failed candidates of BTPG-o that need no new check until a node their search expanded changes
+    std::vector<bool> settled;                                 ///< per edge id
+    std::vector<uint32_t> settleVersions;                      ///< per edge id, incremented by every Settle
+    std::vector<std::vector<std::pair<int, uint32_t>>> watchers; ///< per node id, the settled edges and versions that expanded it
+    std::vector<uint32_t> watchMarks;                          ///< per node id, the watchEpoch of the last Settle that watched it
+    uint32_t watchEpoch = 0;
+    void Settle(int edgeId, std::vector<int> &expanded);
+    bool IsSettled(int edgeId);
+    void NodeChanged(int node);
+    bool CheckSpeculatedValidity(type2Edge *candidateEdge, bool &skipped);
+
+    // Search limits and counters
+    SearchOptions options;
+    SearchReport report;
+    void ReportSearch();
+
+    bool FrontiersMeet(SearchScratch &scratch, int startNode_, int endNode_);
+    bool BidirectionalDFS(SearchScratch &scratch, int startNode_, int endNode_, bool hasTYpe1Edge_);
+    int EnterSearchNode(SearchScratch &scratch, int node_, int endNode_, bool hasTYpe1Edge_);
+    void LeaveSearchEdge(SearchScratch &scratch, int currNode_, uint32_t k);
+
+    // Components of the graph built apart, in parallel
+    struct ComponentBuild
+    {
+        std::vector<int> robotIds; ///< agents of the component, in id order
+        std::vector<int> edgeIds;  ///< edges of the component, in id order, which are the edges of the build
+        BTPG *build = nullptr;     ///< created by the first call that searches the component
+        size_t applied = 0;        ///< reversals of the build already made in the whole graph
+    };
+    bool isComponent = false;                    ///< built for one component of another BTPG, which reports the search
+    std::vector<std::pair<int, int>> reversals;  ///< pass and group of every check of a component that reversed edges
+    std::vector<ComponentBuild> componentBuilds; ///< components with type-2 edges, until all their searches finish
+    BTPG(TPG &base, const std::vector<int> &robotIds, const std::vector<int> &edgeIds, int mode, const SearchOptions &options);
+    void SplitComponents();
+    bool ResumeComponents(CancelToken &token);
+    void ApplyComponentReversals();
+
+    // Snapshots
+    std::string cacheFile; ///< snapshot file loadOrBuild writes once the search finishes, if any
+    uint64_t cacheKey = 0; ///< key of the snapshot file
+    BTPG(int mode);
+    bool saveSnapshot(std::string fileName, uint64_t key);
+    bool loadSnapshot(std::string fileName, uint64_t key);
+    void StoreSnapshot();
 
 public:
     // using TPG::TPG;
     bool finish = false;
-    BTPG(std::string fileName, int mode, int timeInterval);
+    BTPG(std::string fileName, int mode, int timeInterval, int numThreads = 1, bool reduced = false, const SearchOptions &options = SearchOptions());
+    BTPG(TPG &base, int mode, int timeInterval, int numThreads = 1, const SearchOptions &options = SearchOptions());
+    ~BTPG();
+    bool Resume(int budget_ms);
+    bool Resume(CancelToken &token);
+    static BTPG *loadOrBuild(std::string fileName, int mode, int timeInterval, std::string cacheDir, int numThreads = 1, bool reduced = false,
+                             TPG *base = nullptr, const SearchOptions &options = SearchOptions());
+    const SearchReport &getSearchReport() { return report; }
 
     int getNumBiPairs();
     void addBiPair(BiPair *biPair);
     BiPair *getBiPair(int biPairId);
 
+    int getNumBiGroupPairs();
+    void addBiGroupPair(BiGroupPair *biGroupPair);
+    BiGroupPair *getBiGroupPair(int biGroupPairId);
+
     int getNumType2EdgeGroups();
     void addType2EdgeGroup(Type2EdgeGroup *type2EdgeGroup);
     Type2EdgeGroup *getType2EdgeGroup(int type2EdgeGroupId);
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @class CancelToken
+ * @brief A deadline or an explicit cancellation, shared by every search of a BTPG build.
+ *
+ * Once cancelled, the token stays cancelled. Reading the flag is a relaxed
+ * atomic load, so the searches check it at every expansion and read the
+ * clock only every pollInterval expansions.
+ */
+class CancelToken
+{
+public:
+    static const uint32_t pollInterval = 128; ///< Expansions between two reads of the clock
+
+    /**
+     * @brief A token without a deadline, cancelled only by cancel().
+     */
+    CancelToken() {}
+
+    /**
+     * @brief A token that expires budget_ms milliseconds from now, or never if budget_ms is 0.
+     */
+    explicit CancelToken(int budget_ms)
+    {
+        if (budget_ms != 0)
+        {
+            this->hasDeadline = true;
+            this->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(budget_ms);
+        }
+    }
+
+    /**
+     * @brief Cancels the token, from any thread.
+     */
+    void cancel() { this->cancelled.store(true, std::memory_order_relaxed); }
+
+    /**
+     * @brief True once the token was cancelled or its deadline passed, without reading the clock.
+     */
+    bool isCancelled() const { return this->cancelled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief True once the token was cancelled or its deadline passed, reading the clock.
+     */
+    bool expired()
+    {
+        if (isCancelled())
+            return true;
+        if (this->hasDeadline && std::chrono::steady_clock::now() >= this->deadline)
+        {
+            cancel();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    bool hasDeadline = false;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> cancelled{false};
+};
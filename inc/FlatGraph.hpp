@@ -0,0 +1,120 @@
+#pragma once
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @struct FlatGraph
+ * @brief A flat, index-based view of a TPG.
+ *
+ * Node n of agent r at time step t has the dense id agentOffsets[r] + t.
+ * The view owns the type-2 adjacency: type2NextOf and type2PrevOf record the
+ * nodes every edge is linked at, and the CSR arrays of 32-bit edge and node
+ * ids list the edges of every node in edge id order. The type2In arrays
+ * invert the outgoing adjacency: they list every edge at the node it leads
+ * to, where type2Prev lists a reversed edge at the node before it.
+ *
+ * Edges linked after the CSR arrays were built are merged into them in one
+ * pass by TPG::getFlatGraph when the view is next read.
+ */
+struct FlatGraph
+{
+    /**
+     * @struct Type2Link
+     * @brief An edge to append to the adjacency of a node.
+     */
+    struct Type2Link
+    {
+        uint32_t nodeId; ///< Node whose adjacency gets the edge
+        uint32_t edgeId; ///< Id of the edge
+        uint32_t end;    ///< Node stored next to the edge id
+    };
+
+    std::vector<Node *> nodes;     ///< Node of every node id
+    std::vector<int> agentOffsets; ///< First node id of every agent, followed by the number of nodes
+    std::vector<int> robotIds;     ///< Robot of every node id
+    std::vector<int> timeSteps;    ///< Time step of every node id
+
+    std::vector<uint32_t> type2NextOffsets; ///< Start of the outgoing edges of every node id
+    std::vector<uint32_t> type2NextEdges;   ///< Edge ids of the outgoing type-2 edges
+    std::vector<uint32_t> type2NextNodes;   ///< nodeTo of the outgoing type-2 edges
+    std::vector<uint32_t> type2PrevOffsets; ///< Start of the incoming edges of every node id
+    std::vector<uint32_t> type2PrevEdges;   ///< Edge ids of the incoming type-2 edges
+    std::vector<uint32_t> type2PrevNodes;   ///< nodeFrom of the incoming type-2 edges
+    std::vector<uint32_t> type2InOffsets;   ///< Start of the outgoing edges that lead to every node id
+    std::vector<uint32_t> type2InEdges;     ///< Edge ids of the outgoing edges that lead to a node
+    std::vector<uint32_t> type2InNodes;     ///< Nodes whose outgoing edges hold these edges
+    std::vector<int32_t> type2NextOf;       ///< Node whose outgoing edges hold every edge id, or -1 if the edge is not linked
+    std::vector<int32_t> type2PrevOf;       ///< Node whose incoming edges hold every edge id, or -1 if the edge is not linked
+    uint32_t numMergedEdges = 0;            ///< Edges already in the CSR arrays; the later ones are merged when the view is read
+
+    int getNumNodes() const { return nodes.size(); }
+    int getNodeId(int robotId, int timeStep) const { return agentOffsets[robotId] + timeStep; }
+    int getPathLength(int robotId) const { return agentOffsets[robotId + 1] - agentOffsets[robotId]; }
+    /**
+     * @brief The id of the next node on the same path, or -1 at the end of the path.
+     */
+    int getType1Next(int nodeId) const { return nodeId + 1 < agentOffsets[robotIds[nodeId] + 1] ? nodeId + 1 : -1; }
+    /**
+     * @brief The id of the previous node on the same path, or -1 at the start of the path.
+     */
+    int getType1Prev(int nodeId) const { return timeSteps[nodeId] > 0 ? nodeId - 1 : -1; }
+
+    /**
+     * @brief Records that an edge is linked into the outgoing edges of one node and the incoming edges of another.
+     */
+    void linkType2Edge(uint32_t edgeId, int nextOf, int prevOf)
+    {
+        type2NextOf[edgeId] = nextOf;
+        type2PrevOf[edgeId] = prevOf;
+    }
+
+    /**
+     * @brief Appends edges to the CSR arrays, after the edges already at their nodes.
+     * @param next The outgoing edges, in the order they were linked; cleared.
+     * @param prev The incoming edges, in the order they were linked; cleared.
+     * @param in The edges at the nodes they lead to, in the order they were linked; cleared.
+     */
+    void appendType2Links(std::vector<Type2Link> &next, std::vector<Type2Link> &prev, std::vector<Type2Link> &in)
+    {
+        appendLinks(type2NextOffsets, type2NextEdges, type2NextNodes, next);
+        appendLinks(type2PrevOffsets, type2PrevEdges, type2PrevNodes, prev);
+        appendLinks(type2InOffsets, type2InEdges, type2InNodes, in);
+    }
+
+private:
+    // one pass over the arrays from the end: every run of entries moves up by the number of new edges before it,
+    // so a batch costs O(N + E) however many edges it holds
+    static void appendLinks(std::vector<uint32_t> &offsets, std::vector<uint32_t> &edges, std::vector<uint32_t> &ends, std::vector<Type2Link> &links)
+    {
+        if (links.empty())
+            return;
+        std::stable_sort(links.begin(), links.end(), [](const Type2Link &a, const Type2Link &b)
+                         { return a.nodeId < b.nodeId; });
+        size_t readEnd = edges.size();
+        size_t write = edges.size() + links.size();
+        edges.resize(write);
+        ends.resize(write);
+        for (size_t i = links.size(); i-- > 0;)
+        {
+            uint32_t position = offsets[links[i].nodeId + 1];
+            std::move_backward(edges.begin() + position, edges.begin() + readEnd, edges.begin() + write);
+            std::move_backward(ends.begin() + position, ends.begin() + readEnd, ends.begin() + write);
+            write -= readEnd - position;
+            readEnd = position;
+            write--;
+            edges[write] = links[i].edgeId;
+            ends[write] = links[i].end;
+        }
+        size_t added = 0;
+        size_t i = 0;
+        for (size_t n = links[0].nodeId; n + 1 < offsets.size(); n++)
+        {
+            for (; i < links.size() && links[i].nodeId == n; i++)
+                added++;
+            offsets[n + 1] += added;
+        }
+        links.clear();
+    }
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include "FlatGraph.hpp"
+#include "CancelToken.hpp"
+
+#include <cstdint>
+
+/**
+ * @class ReachIndex
+ * @brief The earliest time step of every agent reachable from every node.
+ *
+ * A node that reaches time step t of an agent also reaches all its later
+ * time steps through type-1 edges, so one time step per agent is an exact
+ * reachability oracle over the type-1 and outgoing type-2 edges searched by
+ * the BTPG. The graph may contain cycles through reversed edges, so rows are
+ * computed per strongly connected component, in reverse topological order.
+ */
+class ReachIndex
+{
+private:
+    static constexpr uint16_t unreachable = UINT16_MAX;
+
+    int numAgents = 0;
+    int numNodes = 0;
+    bool built = false;
+    std::vector<uint16_t> earliest; ///< numAgents entries per node id
+    const FlatGraph *flat = nullptr; ///< brought up to date by the BTPG before edges are added to the index
+
+    uint16_t *row(int node) { return &earliest[(size_t)node * numAgents]; }
+    const uint16_t *row(int node) const { return &earliest[(size_t)node * numAgents]; }
+    std::vector<int> worklist; ///< nodes whose predecessors addEdge still has to update
+
+public:
+    /**
+     * @brief Builds the index of a graph, unless it would take more than maxBytes.
+     * @param flat The flat graph, whose type-2 adjacency must be up to date.
+     * @param maxBytes The memory limit of the index.
+     * @return True if the index was built.
+     */
+    bool build(const FlatGraph &flat, size_t maxBytes);
+
+    bool isBuilt() const { return built; }
+
+    /**
+     * @brief Releases the index.
+     */
+    void clear()
+    {
+        built = false;
+        std::vector<uint16_t>().swap(earliest);
+    }
+
+    /**
+     * @brief True if some path leads from one node to another.
+     */
+    bool canReach(int fromNode, int toNode) const
+    {
+        return row(fromNode)[flat->robotIds[toNode]] <= flat->timeSteps[toNode];
+    }
+
+    /**
+     * @brief True if some path leads from one node to another and enters it through a type-2 edge from another agent.
+     */
+    bool canReachByType2(int fromNode, int toNode) const
+    {
+        int toRobot = flat->robotIds[toNode];
+        for (uint32_t k = flat->type2InOffsets[toNode]; k < flat->type2InOffsets[toNode + 1]; k++)
+        {
+            int pred = flat->type2InNodes[k];
+            if (flat->robotIds[pred] != toRobot && (pred == fromNode || canReach(fromNode, pred)))
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Updates the index after a type-2 edge was added to the flat graph.
+     * @param fromNode The node whose outgoing edges hold the edge.
+     * @param toNode The node the edge leads to.
+     * @param cancel A token that stops the update, if any; a stopped update leaves rows out of date, so the index is released.
+     * @return False if the token stopped the update.
+     */
+    bool addEdge(int fromNode, int toNode, CancelToken *cancel = nullptr);
+};
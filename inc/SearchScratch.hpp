@@ -0,0 +1,203 @@
+#pragma once
+#include "FlatGraph.hpp"
+#include "SearchStats.hpp"
+#include "CancelToken.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @struct SearchFrame
+ * @brief A node on the explicit stack of the cycle search.
+ */
+struct SearchFrame
+{
+    int node;            ///< Node id of the frame
+    uint32_t nextEdge;   ///< Next outgoing type-2 edge to try, as an index into the CSR arrays
+    int64_t pendingEdge; ///< CSR index of the type-2 edge the search descended through and has to leave, or -1
+    bool hasType1Edge;   ///< True if the path to the node used a type-1 edge
+    bool type1Done;      ///< True once the type-1 edge of the node was tried
+};
+
+/**
+ * @struct SearchScratch
+ * @brief Reusable state of the cycle search of one singleton check.
+ *
+ * Every entry is stamped with the epoch of the check that wrote it, and an
+ * entry with an older stamp reads as its initial value, so starting a new
+ * check costs O(1) instead of clearing or reallocating the whole state.
+ */
+struct SearchScratch
+{
+    uint32_t epoch = 0; ///< Stamp of the current check
+
+    std::vector<uint32_t> nodeMarks; ///< 2 * epoch + 1 if visited, 2 * epoch if unvisited in the current check
+    std::vector<uint32_t> pathMarks; ///< epoch if the node is on the current search path
+    int prefixBegin = 0;             ///< First node id visited initially
+    int prefixEnd = 0;               ///< End of the node ids visited initially
+
+    std::vector<uint32_t> agentMarks;   ///< Epoch at which the entries of an agent were last reset
+    std::vector<int> agentEdges;        ///< Edge through which the search entered every agent, or -1
+    std::vector<int> agentLeaveEdges;   ///< Edge through which the search left every agent, or -1
+    std::vector<uint32_t> revisitMarks; ///< Epoch at which the revisit list of an edge was last reset
+    std::vector<std::vector<int>> revisitNodes; ///< Nodes to unvisit when the search backtracks over an edge
+
+    std::vector<int> recursionPath; ///< Node ids of the current search path
+    std::vector<SearchFrame> frames; ///< Explicit stack of the search
+
+    int candidateEdgeId = -1; ///< Candidate edge, searched as if it were bidirectional
+    type2Edge probeEdge;      ///< Reversed candidate, seen by the search but not added to the graph
+
+    bool recordExpanded = false; ///< True to record the expanded nodes
+    std::vector<int> expanded;   ///< Node ids expanded by the current check, if recorded
+    std::vector<int> entered;    ///< Node ids whose incoming edges the current check read, if recorded
+
+    std::vector<uint32_t> forwardMarks;  ///< epoch if the frontier of the start node reached the node
+    std::vector<uint32_t> backwardMarks; ///< epoch if the frontier of the end node reached the node
+    std::vector<int> forwardQueue;       ///< Nodes reached from the start node, in the order they are expanded
+    std::vector<int> backwardQueue;      ///< Nodes reached from the end node, in the order they are expanded
+
+    uint64_t maxExpansions = 0; ///< Expansions after which a check gives up and rejects its candidate, 0 for no limit
+    bool recordStats = false;   ///< True to time the checks
+    SearchStats stats;          ///< Counters of the current check
+    CancelToken *cancel = nullptr; ///< Token that stops the search, if any
+    uint32_t polls = 0;            ///< Calls to stopRequested, to read the clock of the token only now and then
+
+    /**
+     * @brief Starts a new check, in which the nodes of the end agent before the end node are visited.
+     * @param flat The flat graph searched.
+     * @param numAgents The number of agents.
+     * @param numEdges The number of type-2 edges, including the probe edge.
+     * @param endNode The node id the search tries to reach.
+     */
+    void begin(const FlatGraph &flat, int numAgents, int numEdges, int endNode)
+    {
+        if (nodeMarks.size() < (size_t)flat.getNumNodes())
+        {
+            nodeMarks.resize(flat.getNumNodes(), 0);
+            pathMarks.resize(flat.getNumNodes(), 0);
+            forwardMarks.resize(flat.getNumNodes(), 0);
+            backwardMarks.resize(flat.getNumNodes(), 0);
+        }
+        if (agentMarks.size() < (size_t)numAgents)
+        {
+            agentMarks.resize(numAgents, 0);
+            agentEdges.resize(numAgents, -1);
+            agentLeaveEdges.resize(numAgents, -1);
+        }
+        if (revisitMarks.size() < (size_t)numEdges)
+        {
+            revisitMarks.resize(numEdges, 0);
+            revisitNodes.resize(numEdges);
+        }
+        // 2 * epoch + 1 must not overflow the node marks
+        if (epoch >= UINT32_MAX / 2 - 1)
+        {
+            std::fill(nodeMarks.begin(), nodeMarks.end(), 0);
+            std::fill(pathMarks.begin(), pathMarks.end(), 0);
+            std::fill(forwardMarks.begin(), forwardMarks.end(), 0);
+            std::fill(backwardMarks.begin(), backwardMarks.end(), 0);
+            std::fill(agentMarks.begin(), agentMarks.end(), 0);
+            std::fill(revisitMarks.begin(), revisitMarks.end(), 0);
+            epoch = 0;
+        }
+        epoch++;
+        prefixBegin = flat.agentOffsets[flat.robotIds[endNode]];
+        prefixEnd = endNode;
+        recursionPath.clear();
+        expanded.clear();
+        entered.clear();
+        stats = SearchStats();
+    }
+
+    /**
+     * @brief True once the search has to stop; the current check is then marked as cancelled.
+     */
+    bool stopRequested()
+    {
+        if (cancel == nullptr)
+            return false;
+        if (cancel->isCancelled() || (++polls % CancelToken::pollInterval == 0 && cancel->expired()))
+        {
+            stats.cancelled = true;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief True if the node is on the path of the end agent before the end node, which no search enters.
+     */
+    bool isBlocked(int node) const { return node >= prefixBegin && node < prefixEnd; }
+
+    bool isVisited(int node) const
+    {
+        if (nodeMarks[node] == 2 * epoch + 1)
+            return true;
+        if (nodeMarks[node] == 2 * epoch)
+            return false;
+        return isBlocked(node);
+    }
+    void setVisited(int node) { nodeMarks[node] = 2 * epoch + 1; }
+    void setUnvisited(int node) { nodeMarks[node] = 2 * epoch; }
+
+    /**
+     * @brief True if the search can step to a node: it is neither visited nor on the current search path.
+     */
+    bool canVisit(int node) const { return pathMarks[node] != epoch && !isVisited(node); }
+    void pushPath(int node)
+    {
+        recursionPath.push_back(node);
+        pathMarks[node] = epoch;
+    }
+    void popPath()
+    {
+        pathMarks[recursionPath.back()] = 0;
+        recursionPath.pop_back();
+    }
+
+    /**
+     * @brief The edge through which the search entered an agent, or -1.
+     */
+    int &agentEdge(int robotId)
+    {
+        touchAgent(robotId);
+        return agentEdges[robotId];
+    }
+    /**
+     * @brief The edge through which the search left an agent, or -1.
+     */
+    int &agentLeaveEdge(int robotId)
+    {
+        touchAgent(robotId);
+        return agentLeaveEdges[robotId];
+    }
+    /**
+     * @brief The nodes to unvisit when the search backtracks over an edge.
+     */
+    std::vector<int> &revisits(int edgeId)
+    {
+        if (revisitMarks[edgeId] != epoch)
+        {
+            revisitMarks[edgeId] = epoch;
+            revisitNodes[edgeId].clear();
+        }
+        return revisitNodes[edgeId];
+    }
+    void addRevisit(int edgeId, int node)
+    {
+        revisits(edgeId).push_back(node);
+        stats.revisits++;
+    }
+
+private:
+    void touchAgent(int robotId)
+    {
+        if (agentMarks[robotId] != epoch)
+        {
+            agentMarks[robotId] = epoch;
+            agentEdges[robotId] = -1;
+            agentLeaveEdges[robotId] = -1;
+        }
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @struct SearchStats
+ * @brief Counters of the cycle search of one check.
+ */
+struct SearchStats
+{
+    uint64_t expanded = 0;  ///< Nodes expanded
+    uint64_t probed = 0;    ///< Nodes expanded by the frontiers before the search
+    uint64_t revisits = 0;  ///< Nodes added to the revisit lists of edges
+    uint32_t maxDepth = 0;  ///< Longest search path
+    uint64_t micros = 0;    ///< Wall time of the check, if timed
+    bool exhausted = false; ///< True if the search stopped at the expansion budget
+    bool cancelled = false; ///< True if the search stopped at the deadline, which leaves the check undecided
+};
+
+/**
+ * @class SearchReport
+ * @brief Aggregate counters and log2 histograms of the checks of a BTPG build.
+ */
+class SearchReport
+{
+public:
+    /**
+     * @struct Histogram
+     * @brief Bucket 0 counts the zeros, bucket i the values in [2^(i-1), 2^i).
+     */
+    struct Histogram
+    {
+        std::vector<uint64_t> buckets;
+        uint64_t total = 0;
+        uint64_t max = 0;
+        void add(uint64_t value);
+        void merge(const Histogram &other);
+    };
+
+    /**
+     * @struct Candidate
+     * @brief A costly check, kept among the most expensive ones.
+     */
+    struct Candidate
+    {
+        int edgeId;
+        int fromId;
+        int toId;
+        SearchStats stats;
+    };
+
+    uint64_t searched = 0;    ///< Checks that ran a search
+    uint64_t unreachable = 0; ///< Checks decided by the reach index
+    uint64_t settled = 0;     ///< Checks skipped because their last search could not change
+    uint64_t exhausted = 0;   ///< Checks rejected at the expansion budget
+    uint64_t valid = 0;       ///< Checks that found no cycle
+    uint64_t cancelled = 0;   ///< Checks stopped at the deadline, and left for the next call
+
+    Histogram expanded;
+    Histogram probed;
+    Histogram revisits;
+    Histogram maxDepth;
+    Histogram micros;
+    std::vector<Candidate> costliest; ///< By expanded nodes, the most first
+
+    /**
+     * @brief Adds the counters of a check that ran a search.
+     */
+    void record(int edgeId, int fromId, int toId, bool valid, const SearchStats &stats);
+
+    /**
+     * @brief Adds the counters of a report on a part of the graph.
+     * @param edgeIds The edge id in this report of every edge id in the other.
+     * @param robotIds The robot id in this report of every robot id in the other.
+     */
+    void merge(const SearchReport &other, const std::vector<int> &edgeIds, const std::vector<int> &robotIds);
+
+    /**
+     * @brief Prints a summary of the counters.
+     */
+    void print(std::ostream &out) const;
+
+    /**
+     * @brief Writes the counters and histograms as JSON.
+     * @return True if the file was written.
+     */
+    bool writeJson(std::string fileName) const;
+};
@@ -8,6 +8,7 @@ class Sim
 private:
     BTPG *btpg = nullptr;
     TPG *tpg = nullptr;
+    const FlatGraph *flat = nullptr; ///< flat view of the graph being simulated
     int seed;
     bool isBTPG = false;
     int mode = 0;
@@ -1,4 +1,9 @@
 #include "util.hpp"
+#include "Arena.hpp"
+#include "FlatGraph.hpp"
+
+#include <functional>
+#include <unordered_map>
 
 class TPG
 {
@@ -7,17 +12,67 @@ private:
     int numTypeTwoEdges;
     std::vector<Agent *> agents;
     std::vector<type2Edge *> type2Edges;
+    bool reduced; ///< only type-2 edges between consecutive visits of a cell
+    bool loaded;  ///< false if the plan file could not be read
+
+    Node *addPathNode(Agent *agent, Node *prev, int x, int y);
+    bool readPlan(std::string fileName);
+    bool parseTextPlan(const char *data, size_t size);
+    bool loadBinaryPlan(const char *data, size_t size);
+
+    // time-sorted visits of every cell
+    std::unordered_map<Coord, std::vector<Node *>, Coord::Hash> cellVisits;
+    void indexCellVisits();
+    void collectTypeTwoEdges(Agent *agent, std::vector<std::pair<Node *, Node *>> &edges);
+    type2Edge *connectTypeTwoEdge(Node *nodeFrom, Node *nodeTo);
+    void sweepCellVisits(const std::vector<Node *> &visits, size_t first, const std::function<bool(size_t)> &unordered);
+
+    FlatGraph flatGraph;
+    bool flatGraphDirty; ///< the CSR arrays miss some nodes and are rebuilt when next read
+    void buildFlatAdjacency();
+    void mergeFlatAdjacency();
+    void findType2Next(int nodeId, std::vector<type2Edge *> &edges);
+
+    // weakly connected components of the agents, joined by the type-2 edges
+    std::vector<int> componentIds;                ///< Component of every agent
+    std::vector<std::vector<int>> componentAgents; ///< Agents of every component, in id order
+    bool componentsDirty;                         ///< some agents or type-2 edges were added since the components were found
+    void findComponents();
+
+protected:
+    GraphArena arena; ///< owns every graph object of this TPG
+
+    void saveGraph(std::ostream &out);
+    bool loadGraph(std::istream &in);
+    void copyGraph(TPG &other);
+    void copyAgents(TPG &other, const std::vector<int> &robotIds, const std::vector<int> &edgeIds);
 
 public:
-    TPG(std::string fileName);
-    // ~TPG();
+    TPG();
+    TPG(std::string fileName, int numThreads = 1, bool reduced = false);
+    virtual ~TPG();
 
+    bool isReduced();
+    bool isLoaded();
     int getNumAgents();
     int getNumTypeTwoEdges();
     void addRobot(Agent *agent);
+    int appendAgentPath(const std::vector<Coord> &path);
     void addTypeTwoEdge(type2Edge *edge);
-    void removeTypeTwoEdge(type2Edge *edge);
+    void connectBypassEdges(type2Edge *edge);
+    void linkTypeTwoEdge(type2Edge *edge, Node *nextOf, Node *prevOf);
+    bool checkVisitOrders();
 
     Agent *getAgent(int robotId);
     type2Edge *getTypeTwoEdge(int edgeId);
+    Node *getNode(int robotId, int timeStep);
+    const FlatGraph &getFlatGraph();
+
+    int getNumComponents();
+    int getComponentId(int robotId);
+    const std::vector<int> &getComponentAgents(int componentId);
+
+    bool writeBinaryPlan(std::string fileName);
+    static int convertPlan(std::string planFile, std::string binaryFile);
+    void printMemoryUsage();
 };
\ No newline at end of file
@@ -62,20 +62,18 @@ struct Coord
     };
 };
 
-struct type2Edge;
 /**
  * @struct Node
  * @brief A structure representing a node in the TPG.
  */
 struct Node
 {
-    Coord coord;                        ///< The coordinates of the Node in the map
-    Node *Type1Next;                    ///< Pointer to the next Node of type 1
-    std::vector<type2Edge *> Type2Next; ///< Vector of pointers to the next Nodes of type 2
-    Node *Type1Prev;                    ///< Pointer to the previous Node of type 1
-    std::vector<type2Edge *> Type2Prev; ///< Vector of pointers to the previous Nodes of type 2
-    int timeStep;                       ///< The time step at which this Node exists
-    int robotId;                        ///< The ID of the robot at this Node
+    Coord coord;     ///< The coordinates of the Node in the map
+    Node *Type1Next; ///< Pointer to the next Node of type 1
+    Node *Type1Prev; ///< Pointer to the previous Node of type 1
+    int timeStep;    ///< The time step at which this Node exists
+    int robotId;     ///< The ID of the robot at this Node
+    int nodeId;      ///< The dense ID of this Node in the flat graph, which holds its type-2 edges
     /**
      * @brief Default constructor for Node.
      */
@@ -84,20 +82,18 @@ struct Node
         coord = Coord();
         Type1Next = NULL;
         Type1Prev = NULL;
-        Type2Next = std::vector<type2Edge *>();
-        Type2Prev = std::vector<type2Edge *>();
         timeStep = -1;
         robotId = -1;
+        nodeId = -1;
     };
     Node(int x, int y)
     {
         coord = Coord(x, y);
         Type1Next = NULL;
         Type1Prev = NULL;
-        Type2Next = std::vector<type2Edge *>();
-        Type2Prev = std::vector<type2Edge *>();
         this->timeStep = -1;
         this->robotId = -1;
+        this->nodeId = -1;
     };
 
     // overwrite << operator
@@ -241,6 +237,7 @@ struct BiGroupPair
 
     // Simulation
     bool isVisited = false; ///< True if this BiPair has been visited, false otherwise
+    int claimedBy = -1;     ///< The agent that passes through the groups first, once visited
 
     /**
      * @brief Constructor that initializes the BiPair with the given original and flipped IDs.
@@ -261,4 +258,27 @@ struct BiGroupPair
         this->originalId = -1;
         this->flippedId = -1;
     }
-};
\ No newline at end of file
+};
+/**
+ * @brief Writes the bytes of a trivially copyable value to a binary stream.
+ * @param os The stream to write to.
+ * @param value The value to write.
+ */
+template <typename T>
+void writeBinary(std::ostream &os, const T &value)
+{
+    os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/**
+ * @brief Reads the bytes of a trivially copyable value from a binary stream.
+ * @param is The stream to read from.
+ * @param value The value to fill.
+ * @return True if the value could be read, false otherwise.
+ */
+template <typename T>
+bool readBinary(std::istream &is, T &value)
+{
+    is.read(reinterpret_cast<char *>(&value), sizeof(T));
+    return static_cast<bool>(is);
+}
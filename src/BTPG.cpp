@@ -2,139 +2,541 @@
 #include <boost/property_tree/ptree.hpp>
 #include "Sim.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
 const int BTPG_n = 0;
 const int BTPG_o = 1;
 
-BTPG::BTPG(std::string fileName, int mode, int timeInterval)
-    : TPG(fileName)
+// the reach index is skipped on plans where it would take more memory
+static const size_t reachIndexMaxBytes = 512 << 20;
+// and dropped after this many searches in a row that it could not skip
+static const int reachIndexMaxMisses = 256;
+
+// snapshot file: magic, version, cache key, the graph, the groups, the BiPairs, the BiGroupPairs, the check order and the search progress
+static const char snapshotMagic[8] = {'B', 'T', 'P', 'G', 'S', 'N', 'A', 'P'};
+static const uint32_t snapshotVersion = 5;
+
+// FNV-1a hash of the plan file and of the parameters the BTPG is built with
+static uint64_t snapshotKey(std::string fileName, int mode, int timeInterval, bool reduced, const SearchOptions &options)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const char *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    std::ifstream file(fileName, std::ios::binary);
+    char buffer[1 << 16];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+    {
+        mix(buffer, file.gcount());
+    }
+    int params[3] = {mode, timeInterval, reduced ? 1 : 0};
+    mix(reinterpret_cast<const char *>(params), sizeof(params));
+    // a budget can lose BiPairs; without one, the keys of existing snapshots are unchanged
+    if (options.maxExpansions != 0)
+        mix(reinterpret_cast<const char *>(&options.maxExpansions), sizeof(options.maxExpansions));
+    if (options.groupReversal)
+        mix("groups", 6);
+    if (options.prioritize)
+        mix("prioritized", 11);
+    if (options.giveUpCancelled)
+        mix("giveUpCancelled", 15);
+    return hash;
+}
+
+// constructor of an empty BTPG, filled by loadSnapshot
+BTPG::BTPG(int mode)
+    : TPG()
+{
+    this->mode = mode;
+    this->numBiPairs = 0;
+    this->naiveNegativeCase = 0;
+}
+
+BTPG::BTPG(std::string fileName, int mode, int timeInterval, int numThreads, bool reduced, const SearchOptions &options)
+    : TPG(fileName, numThreads, reduced)
+{
+    this->mode = mode;
+    this->numThreads = numThreads;
+    this->options = options;
+    this->numBiPairs = 0;
+    this->naiveNegativeCase = 0;
+    GroupType2Edges();
+    SplitComponents();
+    Resume(timeInterval);
+}
+
+// constructor of BTPG on a copy of an already built TPG
+BTPG::BTPG(TPG &base, int mode, int timeInterval, int numThreads, const SearchOptions &options)
+    : TPG()
+{
+    this->mode = mode;
+    this->numThreads = numThreads;
+    this->options = options;
+    this->numBiPairs = 0;
+    this->naiveNegativeCase = 0;
+    copyGraph(base);
+    GroupType2Edges();
+    SplitComponents();
+    Resume(timeInterval);
+}
+
+// constructor of BTPG on a copy of one component of a TPG, searched by the caller
+BTPG::BTPG(TPG &base, const std::vector<int> &robotIds, const std::vector<int> &edgeIds, int mode, const SearchOptions &options)
+    : TPG()
 {
     this->mode = mode;
+    this->options = options;
     this->numBiPairs = 0;
     this->naiveNegativeCase = 0;
+    this->isComponent = true;
+    copyAgents(base, robotIds, edgeIds);
+    GroupType2Edges();
+}
+
+// every component build is deleted when the search finishes, unless the BTPG goes first
+BTPG::~BTPG()
+{
+    for (auto &part : this->componentBuilds)
+    {
+        delete part.build;
+    }
+}
+
+// search the components with type-2 edges apart, in parallel, and reverse their edges here in the order
+// a single search of the whole graph reverses them: no search leaves the component of its candidate,
+// so every check finds the same graph within its component either way
+void BTPG::SplitComponents()
+{
+    if (this->numThreads <= 1)
+        return;
+    // the edges of every component, in id order, are the edges of its BTPG
+    std::vector<std::vector<int>> componentEdges(getNumComponents());
+    for (int e = 0; e < getNumTypeTwoEdges(); e++)
+    {
+        componentEdges[getComponentId(getTypeTwoEdge(e)->nodeFrom->robotId)].push_back(e);
+    }
+    std::vector<int> components;
+    for (int c = 0; c < getNumComponents(); c++)
+    {
+        if (!componentEdges[c].empty())
+            components.push_back(c);
+    }
+    if (components.size() < 2)
+        return;
+    // the largest first, so that none of them starts last
+    std::stable_sort(components.begin(), components.end(), [&](int a, int b)
+                     { return componentEdges[a].size() > componentEdges[b].size(); });
+#ifdef DEBUG
+    std::cout << "Number of components with type-2 edges: " << components.size() << std::endl;
+#endif
+    for (int c : components)
+    {
+        this->componentBuilds.push_back(ComponentBuild{getComponentAgents(c), std::move(componentEdges[c])});
+    }
+}
+
+// continue the search of every component build until it finishes or the token is cancelled, each build from its
+// own cursor and pass, and reverse here the edges no check of any build can come before any more
+bool BTPG::ResumeComponents(CancelToken &token)
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < std::min<int>(this->numThreads, this->componentBuilds.size()); t++)
+    {
+        workers.emplace_back([&]()
+                             {
+            size_t i;
+            while ((i = next.fetch_add(1)) < this->componentBuilds.size())
+            {
+                if (token.expired())
+                    continue;
+                ComponentBuild &part = this->componentBuilds[i];
+                if (part.build == nullptr)
+                    part.build = new BTPG(*this, part.robotIds, part.edgeIds, this->mode, this->options);
+                part.build->Resume(token);
+            } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    ApplyComponentReversals();
+
+    for (auto &part : this->componentBuilds)
+    {
+        if (part.build == nullptr || !part.build->finish)
+            return false;
+    }
+    for (auto &part : this->componentBuilds)
+    {
+        this->naiveNegativeCase += part.build->naiveNegativeCase;
+        this->report.merge(part.build->report, part.edgeIds, part.robotIds);
+        delete part.build;
+    }
+    this->componentBuilds.clear();
+    this->finish = true;
+    if (this->options.collectStats || !this->options.statsFile.empty())
+        ReportSearch();
+    StoreSnapshot();
+    return true;
+}
+
+// reverse here, sorted by pass and position of their group in a pass over the whole graph, the reversals of the
+// component builds that come before the next check of every build; the later ones wait for the next call
+void BTPG::ApplyComponentReversals()
+{
+    std::vector<int> positions(getNumType2EdgeGroups());
+    for (int i = 0; i < getNumType2EdgeGroups(); i++)
+    {
+        positions[GroupAt(i)->groupId] = i;
+    }
+    // the groups a build flipped come after the ones of the whole graph in a pass
+    auto position = [&](const ComponentBuild &part, Type2EdgeGroup *group)
+    {
+        int edgeId = group->type2Edges[0]->edgeId;
+        return edgeId < (int)part.edgeIds.size() ? positions[getTypeTwoEdge(part.edgeIds[edgeId])->groupId] : INT32_MAX;
+    };
+    // a build not created yet comes before every reversal, and a finished one after them
+    std::pair<int, int> frontier(INT32_MAX, INT32_MAX);
+    for (auto &part : this->componentBuilds)
+    {
+        BTPG *build = part.build;
+        std::pair<int, int> nextCheck(0, 0);
+        if (build != nullptr && build->finish)
+            nextCheck = std::make_pair(INT32_MAX, INT32_MAX);
+        else if (build != nullptr)
+            nextCheck = std::make_pair(build->groupPass ? INT32_MAX : build->pass,
+                                       build->groupCursor < build->getNumType2EdgeGroups() ? position(part, build->GroupAt(build->groupCursor)) : INT32_MAX);
+        frontier = std::min(frontier, nextCheck);
+    }
+
+    // the reversals of a build come in the order it made them
+    std::vector<std::pair<std::pair<int, int>, int>> order;
+    for (auto &part : this->componentBuilds)
+    {
+        for (; part.build != nullptr && part.applied < part.build->reversals.size(); part.applied++)
+        {
+            std::pair<int, int> &reversal = part.build->reversals[part.applied];
+            Type2EdgeGroup *group = part.build->getType2EdgeGroup(reversal.second);
+            std::pair<int, int> key(reversal.first, position(part, group));
+            if (!(key < frontier))
+                break;
+            order.push_back(std::make_pair(key, getTypeTwoEdge(part.edgeIds[group->type2Edges[0]->edgeId])->groupId));
+        }
+    }
+    std::sort(order.begin(), order.end());
+    this->changedMarks.resize(getFlatGraph().getNumNodes(), 0);
+    this->changedInMarks.resize(getFlatGraph().getNumNodes(), 0);
+    for (auto &reversal : order)
+    {
+        Type2EdgeGroup *group = getType2EdgeGroup(reversal.second);
+        if (group->type2Edges.size() > 1)
+            ReverseGroup(group);
+        else
+            ReverseEdge(group->type2Edges[0]);
+    }
+}
+
+// group the type-2 edges into chains between the same pair of agents
+void BTPG::GroupType2Edges()
+{
     // Grouping
 #ifdef DEBUG
     std::cout << "| BTPG constructor |" << std::endl;
     std::cout << "Start Grouping ..." << std::endl;
 #endif
-    for (int i = 0; i < getNumAgents(); i++)
+    // a group only holds edges leaving one agent, so agents are grouped independently
+    const FlatGraph &flat = getFlatGraph();
+    std::vector<std::vector<std::vector<type2Edge *>>> agentGroups(getNumAgents());
+    if (this->numThreads <= 1)
     {
-        Agent *agent = getAgent(i);
-        Node *node = agent->Type1Next;
-
-        while (node != NULL)
+        for (int i = 0; i < getNumAgents(); i++)
         {
-            if (node->Type2Next.size() > 0)
-            {
-                for (auto &edge : node->Type2Next)
+            GroupAgentEdges(flat, i, agentGroups[i]);
+        }
+    }
+    else
+    {
+        std::atomic<int> nextAgent(0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < this->numThreads; t++)
+        {
+            workers.emplace_back([&]()
+                                 {
+                int i;
+                while ((i = nextAgent.fetch_add(1)) < getNumAgents())
                 {
-                    if (edge->isGrouped)
-                        continue;
-                    int toId = edge->nodeTo->robotId;
-                    int timeStep = edge->nodeTo->timeStep;
-                    Node *fromNode = node;
-                    Type2EdgeGroup *group = new Type2EdgeGroup();
-                    int groupId = getNumType2EdgeGroups();
-                    group->fromId = fromNode->robotId;
-                    fromNode = fromNode->Type1Next;
-                    group->type2Edges.push_back(edge);
-                    group->toId = toId;
-                    edge->isGrouped = true;
-                    edge->groupId = groupId;
-
-                    while (fromNode != NULL)
-                    {
-                        bool found = false;
-                        for (auto &edge2 : fromNode->Type2Next)
-                        {
-                            if (edge2->isGrouped)
-                                continue;
-                            if (edge2->nodeTo->robotId == toId && (edge2->nodeTo->timeStep == timeStep + 1 || edge2->nodeTo->timeStep == timeStep - 1))
-                            {
-                                group->type2Edges.push_back(edge2);
-                                edge2->isGrouped = true;
-                                edge2->groupId = groupId;
-                                timeStep = edge2->nodeTo->timeStep;
-                                found = true;
-                                break;
-                            }
-                        }
-                        if (!found)
-                            break;
-                        fromNode = fromNode->Type1Next;
-                    }
+                    GroupAgentEdges(flat, i, agentGroups[i]);
+                } });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
 
-                    addType2EdgeGroup(group);
-                }
+    // number the groups in agent order, as a single pass over the node ids would
+    for (int i = 0; i < getNumAgents(); i++)
+    {
+        for (auto &edges : agentGroups[i])
+        {
+            Type2EdgeGroup *group = this->arena.type2EdgeGroups.create();
+            int groupId = getNumType2EdgeGroups();
+            group->groupId = groupId;
+            group->fromId = i;
+            group->toId = flat.robotIds[edges[0]->nodeTo->nodeId];
+            group->type2Edges.swap(edges);
+            for (auto &edge : group->type2Edges)
+            {
+                edge->groupId = groupId;
             }
-            node = node->Type1Next;
+            addType2EdgeGroup(group);
         }
     }
 
+    if (this->options.prioritize)
+        OrderCandidates();
+
 #ifdef DEBUG
     std::cout << "End Grouping." << std::endl;
     std::cout << "******** Grouping Info ********" << std::endl;
     std::cout << "Number of groups: " << getNumType2EdgeGroups() << std::endl;
     std::cout << "Start BTPG ..." << std::endl;
 #endif
+}
+
+// group the edges leaving one agent; a group is extended by the first ungrouped edge of the next node
+// that leads to the same agent one time step later or earlier
+void BTPG::GroupAgentEdges(const FlatGraph &flat, int robotId, std::vector<std::vector<type2Edge *>> &groups)
+{
+    int firstNode = flat.agentOffsets[robotId];
+    int lastNode = flat.agentOffsets[robotId + 1];
+    uint32_t begin = flat.type2NextOffsets[firstNode];
+    uint32_t end = flat.type2NextOffsets[lastNode];
+
+    // the outgoing edges of the agent sorted by (fromNode, toNode), keeping their order within a key
+    std::vector<std::pair<uint64_t, uint32_t>> sorted;
+    sorted.reserve(end - begin);
+    for (int node = firstNode; node < lastNode; node++)
+    {
+        for (uint32_t k = flat.type2NextOffsets[node]; k < flat.type2NextOffsets[node + 1]; k++)
+            sorted.push_back(std::make_pair((uint64_t)node << 32 | flat.type2NextNodes[k], k));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    // first entry of every key that may still be ungrouped
+    std::unordered_map<uint64_t, uint32_t> firstOfKey;
+    firstOfKey.reserve(sorted.size());
+    for (uint32_t i = sorted.size(); i-- > 0;)
+    {
+        firstOfKey[sorted[i].first] = i;
+    }
+    // the first ungrouped edge from a node to another, as a CSR index, or UINT32_MAX
+    auto firstUngrouped = [&](int fromNode, int toNode) -> uint32_t
+    {
+        uint64_t key = (uint64_t)fromNode << 32 | (uint32_t)toNode;
+        auto it = firstOfKey.find(key);
+        if (it == firstOfKey.end())
+            return UINT32_MAX;
+        uint32_t &i = it->second;
+        while (i < sorted.size() && sorted[i].first == key && getTypeTwoEdge(flat.type2NextEdges[sorted[i].second])->isGrouped)
+            i++;
+        return i < sorted.size() && sorted[i].first == key ? sorted[i].second : UINT32_MAX;
+    };
+
+    for (int node = firstNode; node < lastNode; node++)
+    {
+        for (uint32_t k = flat.type2NextOffsets[node]; k < flat.type2NextOffsets[node + 1]; k++)
+        {
+            type2Edge *edge = getTypeTwoEdge(flat.type2NextEdges[k]);
+            if (edge->isGrouped)
+                continue;
+            int toId = flat.robotIds[flat.type2NextNodes[k]];
+            int timeStep = flat.timeSteps[flat.type2NextNodes[k]];
+            groups.emplace_back(1, edge);
+            std::vector<type2Edge *> &group = groups.back();
+            edge->isGrouped = true;
+
+            for (int fromNode = flat.getType1Next(node); fromNode != -1; fromNode = flat.getType1Next(fromNode))
+            {
+                // the earlier of the two candidates in the adjacency of the node
+                uint32_t found = UINT32_MAX;
+                if (timeStep + 1 < flat.getPathLength(toId))
+                    found = firstUngrouped(fromNode, flat.getNodeId(toId, timeStep + 1));
+                if (timeStep > 0)
+                    found = std::min(found, firstUngrouped(fromNode, flat.getNodeId(toId, timeStep - 1)));
+                if (found == UINT32_MAX)
+                    break;
+                type2Edge *edge2 = getTypeTwoEdge(flat.type2NextEdges[found]);
+                group.push_back(edge2);
+                edge2->isGrouped = true;
+                timeStep = flat.timeSteps[flat.type2NextNodes[found]];
+            }
+        }
+    }
+}
+
+// order the groups by the benefit of reversing them over the cost of checking them, estimated from their first edge
+// A(f) -> B(t): B waits at t - 1 only if A is delayed by about t - f steps on its first f steps, and a wait of B
+// delays the rest of its path; the search starts from B's later nodes, so their outgoing edges make it costly
+void BTPG::OrderCandidates()
+{
+    const FlatGraph &flat = getFlatGraph();
+    std::vector<double> scores(getNumType2EdgeGroups());
+    for (int i = 0; i < getNumType2EdgeGroups(); i++)
+    {
+        type2Edge *edge = getType2EdgeGroup(i)->type2Edges[0];
+        int toId = edge->nodeTo->robotId;
+        double exposure = edge->nodeFrom->timeStep;
+        double slack = std::max(1, edge->nodeTo->timeStep - edge->nodeFrom->timeStep);
+        double remaining = flat.getPathLength(toId) - edge->nodeTo->timeStep;
+        double cost = 1 + flat.type2NextOffsets[flat.agentOffsets[toId + 1]] - flat.type2NextOffsets[edge->nodeTo->nodeId];
+        scores[i] = exposure * remaining / (slack * cost);
+    }
+    this->checkOrder.resize(getNumType2EdgeGroups());
+    for (int i = 0; i < getNumType2EdgeGroups(); i++)
+    {
+        this->checkOrder[i] = i;
+    }
+    // ties keep the group order, so a component orders its groups as the whole graph does
+    std::stable_sort(this->checkOrder.begin(), this->checkOrder.end(), [&](int a, int b)
+                     { return scores[a] > scores[b]; });
+}
+
+// the group checked at a position of a pass; groups flipped during the search come after the ordered ones
+Type2EdgeGroup *BTPG::GroupAt(int position)
+{
+    return getType2EdgeGroup(position < (int)this->checkOrder.size() ? this->checkOrder[position] : position);
+}
+
+// continue the BiPair search where the last call stopped, for at most budget_ms milliseconds (0: no limit)
+bool BTPG::Resume(int budget_ms)
+{
+    CancelToken token(budget_ms);
+    return Resume(token);
+}
+
+// continue the BiPair search until it finishes or the token is cancelled; the searches poll the token, and a
+// check it stops is left for the next call, so the graph only ever holds whole reversals
+bool BTPG::Resume(CancelToken &token)
+{
+    if (this->finish)
+        return true;
+    if (!this->componentBuilds.empty())
+        return ResumeComponents(token);
+    // BTPG-o keeps the expanded nodes of every search, to check a failed candidate again only once one of them changed
+    this->scratch.recordExpanded = this->mode == 1;
+    this->scratch.maxExpansions = this->options.maxExpansions;
+    this->scratch.recordStats = this->options.collectStats || !this->options.statsFile.empty();
+    this->scratch.cancel = &token;
+    if (!this->reachTried)
+    {
+        this->reachTried = true;
+        this->reach.build(getFlatGraph(), reachIndexMaxBytes);
+    }
+    // sized before any reversal, which marks its nodes even when the group pass comes before any speculation
+    if (this->numThreads > 1)
+    {
+        this->changedMarks.resize(getFlatGraph().getNumNodes(), 0);
+        this->changedInMarks.resize(getFlatGraph().getNumNodes(), 0);
+    }
+    auto stop = [&]()
+    {
+#ifdef DEBUG
+        std::cout << "End BTPG." << std::endl;
+        std::cout << "******** BTPG Info ********" << std::endl;
+        std::cout << "Number of type-2 edge sigleton: " << this->type2EdgeSigleton << std::endl;
+        std::cout << "Number of BiPairs: " << getNumBiPairs() << std::endl;
+        std::cout << "Number of naive negative cases: " << this->naiveNegativeCase << std::endl;
+        std::cout << "******** ***** ********" << std::endl;
+#endif
+        this->scratch.cancel = nullptr;
+        return false;
+    };
+#ifdef DEBUG
     // count time
     auto start = std::chrono::high_resolution_clock::now();
-    int type2EdgeSigleton = 0;
-    int addMorePairs = 1;
-    while (addMorePairs != 0)
+#endif
+    while (true)
     {
-        addMorePairs = 0;
-        type2EdgeSigleton = 0;
-        for (int i = 0; i < getNumType2EdgeGroups(); i++)
+        for (; this->groupCursor < getNumType2EdgeGroups(); this->groupCursor++)
         {
-            Type2EdgeGroup *group = getType2EdgeGroup(i);
-            if (group->type2Edges.size() > 1)
+            Type2EdgeGroup *group = GroupAt(this->groupCursor);
+            if ((group->type2Edges.size() > 1) != this->groupPass || group->isBidirectional)
             {
-                // CheckGroup(group) //TODO: Next Step
                 continue;
             }
             else
             {
-                auto endAnytime = std::chrono::high_resolution_clock::now();
-                auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endAnytime - start).count();
-                if (timeInterval != 0 && duration > timeInterval)
+                if (token.expired())
+                    return stop();
+                int biPairNum = getNumBiPairs();
+                // the cursor stays on a cancelled check, which the next call starts with
+                if (group->type2Edges.size() > 1)
                 {
-
-#ifdef DEBUG
-                    std::cout << "End BTPG." << std::endl;
-                    std::cout << "******** BTPG Info ********" << std::endl;
-                    std::cout << "Number of type-2 edge sigleton: " << type2EdgeSigleton << std::endl;
-                    std::cout << "Number of BiPairs: " << getNumBiPairs() << std::endl;
-                    std::cout << "Number of naive negative cases: " << this->naiveNegativeCase << std::endl;
-                    std::cout << "******** ***** ********" << std::endl;
-#endif
-                    return;
+                    if (!CheckGroup(group))
+                    {
+                        this->cancelledGroup = group->groupId;
+                        return stop();
+                    }
                 }
-                type2EdgeSigleton++;
-                int biPairNum = getNumBiPairs();
-                if (group->type2Edges[0]->isBidirectional)
-                    continue;
-                CheckSingleton(group->type2Edges[0]);
+                else
+                {
+                    if (group->type2Edges[0]->isBidirectional)
+                    {
+                        this->type2EdgeSigleton++;
+                        continue;
+                    }
+                    if (!CheckSingleton(group->type2Edges[0]))
+                    {
+                        this->cancelledGroup = group->groupId;
+                        return stop();
+                    }
+                    this->type2EdgeSigleton++;
+                }
+                this->cancelledGroup = -1;
                 if (biPairNum != getNumBiPairs())
                 {
-                    addMorePairs++;
+                    this->passNewPairs++;
+                    if (this->isComponent)
+                        this->reversals.push_back(std::make_pair(this->groupPass ? INT32_MAX : this->pass, group->groupId));
                 }
             }
         }
+        this->groupCursor = 0;
 #ifdef DEBUG
         std::cout << "current loop:" << getNumBiPairs() << std::endl;
 #endif
-        if (this->mode == 0)
+        // BTPG-o repeats the passes until one adds no BiPair
+        if (this->mode == 0 || this->passNewPairs == 0)
         {
-            addMorePairs = 0;
+            // then the groups are reversed in a single pass, so that no singleton is reversed after them
+            if (this->groupPass || !this->options.groupReversal)
+                break;
+            this->groupPass = true;
+            continue;
         }
+        this->passNewPairs = 0;
+        this->type2EdgeSigleton = 0;
+        this->pass++;
     }
 
-    auto end = std::chrono::high_resolution_clock::now();
     this->finish = true;
+    this->scratch.cancel = nullptr;
 #ifdef DEBUG
+    auto end = std::chrono::high_resolution_clock::now();
     std::cout << "End BTPG." << std::endl;
     std::cout << "******** BTPG Info ********" << std::endl;
-    std::cout << "Number of type-2 edge sigleton: " << type2EdgeSigleton << std::endl;
+    std::cout << "Number of type-2 edge sigleton: " << this->type2EdgeSigleton << std::endl;
     std::cout << "Number of BiPairs: " << getNumBiPairs() << std::endl;
     std::cout << "Number of naive negative cases: " << this->naiveNegativeCase << std::endl;
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << "ms" << std::endl;
@@ -144,6 +546,228 @@ BTPG::BTPG(std::string fileName, int mode, int timeInterval)
 #ifdef DEBUG
     std::cout << "Start output BTPG ..." << std::endl;
 #endif
+    if (this->scratch.recordStats && !this->isComponent)
+        ReportSearch();
+    StoreSnapshot();
+    return true;
+}
+
+// print the counters of the search and write them to the stats file
+void BTPG::ReportSearch()
+{
+    if (this->options.collectStats)
+        this->report.print(std::cout);
+    if (!this->options.statsFile.empty() && !this->report.writeJson(this->options.statsFile))
+    {
+        std::cerr << "Cannot write the search statistics: " << this->options.statsFile << std::endl;
+    }
+}
+
+// load the BTPG of a plan from the cache directory, or build it and store it there
+BTPG *BTPG::loadOrBuild(std::string fileName, int mode, int timeInterval, std::string cacheDir, int numThreads, bool reduced, TPG *base,
+                         const SearchOptions &options)
+{
+    uint64_t key = snapshotKey(fileName, mode, timeInterval, reduced, options);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.snap", (unsigned long long)key);
+    std::string snapshotFile = cacheDir + "/" + name;
+
+    BTPG *btpg = new BTPG(mode);
+    btpg->options = options;
+    if (btpg->loadSnapshot(snapshotFile, key))
+    {
+#ifdef DEBUG
+        std::cout << "Loaded BTPG snapshot " << snapshotFile << std::endl;
+#endif
+        return btpg;
+    }
+    delete btpg;
+
+    btpg = base != nullptr ? new BTPG(*base, mode, timeInterval, numThreads, options)
+                           : new BTPG(fileName, mode, timeInterval, numThreads, reduced, options);
+    // a search stopped by the time interval is only cached once a later Resume finishes it
+    btpg->cacheFile = snapshotFile;
+    btpg->cacheKey = key;
+    if (btpg->finish)
+        btpg->StoreSnapshot();
+    return btpg;
+}
+
+// write the finished BTPG to the snapshot file given by loadOrBuild, if any
+void BTPG::StoreSnapshot()
+{
+    if (this->cacheFile.empty())
+        return;
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(this->cacheFile).parent_path(), error);
+    if (!saveSnapshot(this->cacheFile, this->cacheKey))
+    {
+        std::cerr << "Cannot write the BTPG snapshot: " << this->cacheFile << std::endl;
+    }
+    this->cacheFile.clear();
+}
+
+bool BTPG::saveSnapshot(std::string fileName, uint64_t key)
+{
+    // write next to the snapshot and rename, so readers never see a partial file
+    std::string tempFile = fileName + ".tmp" + std::to_string(getpid());
+    std::ofstream out(tempFile, std::ios::binary);
+    if (!out)
+        return false;
+    out.write(snapshotMagic, sizeof(snapshotMagic));
+    writeBinary(out, snapshotVersion);
+    writeBinary(out, key);
+    saveGraph(out);
+
+    writeBinary(out, (uint32_t)getNumType2EdgeGroups());
+    for (auto &group : this->Type2EdgeGroups)
+    {
+        writeBinary(out, (int32_t)group->groupId);
+        writeBinary(out, (int32_t)group->fromId);
+        writeBinary(out, (int32_t)group->toId);
+        writeBinary(out, (int32_t)group->biGroupId);
+        writeBinary(out, (int32_t)(group->earliestOutEdge != nullptr ? group->earliestOutEdge->edgeId : -1));
+        writeBinary(out, (int32_t)(group->earliestInEdge != nullptr ? group->earliestInEdge->edgeId : -1));
+        writeBinary(out, (uint8_t)((group->canBeReversed ? 1 : 0) | (group->isBidirectional ? 2 : 0)));
+        writeBinary(out, (uint32_t)group->type2Edges.size());
+        for (auto &edge : group->type2Edges)
+            writeBinary(out, (int32_t)edge->edgeId);
+    }
+
+    writeBinary(out, (uint32_t)getNumBiPairs());
+    for (auto &biPair : this->BiPairs)
+    {
+        writeBinary(out, (int32_t)biPair->id);
+        writeBinary(out, (int32_t)biPair->originalId);
+        writeBinary(out, (int32_t)biPair->flippedId);
+    }
+    writeBinary(out, (uint32_t)getNumBiGroupPairs());
+    for (auto &biGroupPair : this->BiGroupPairs)
+    {
+        writeBinary(out, (int32_t)biGroupPair->id);
+        writeBinary(out, (int32_t)biGroupPair->originalId);
+        writeBinary(out, (int32_t)biGroupPair->flippedId);
+    }
+    writeBinary(out, (uint32_t)this->checkOrder.size());
+    for (auto &groupId : this->checkOrder)
+    {
+        writeBinary(out, (int32_t)groupId);
+    }
+    writeBinary(out, (uint8_t)this->finish);
+    writeBinary(out, (uint8_t)this->groupPass);
+    writeBinary(out, (int32_t)this->naiveNegativeCase);
+    writeBinary(out, (int32_t)this->groupCursor);
+    writeBinary(out, (int32_t)this->passNewPairs);
+    writeBinary(out, (int32_t)this->type2EdgeSigleton);
+    out.close();
+    if (!out)
+    {
+        std::remove(tempFile.c_str());
+        return false;
+    }
+    return std::rename(tempFile.c_str(), fileName.c_str()) == 0;
+}
+
+bool BTPG::loadSnapshot(std::string fileName, uint64_t key)
+{
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in)
+        return false;
+    char magic[sizeof(snapshotMagic)];
+    uint32_t version;
+    uint64_t storedKey;
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, snapshotMagic, sizeof(magic)) != 0 || !readBinary(in, version) || !readBinary(in, storedKey) ||
+        version != snapshotVersion || storedKey != key)
+    {
+        std::cerr << "Rejecting stale BTPG snapshot: " << fileName << std::endl;
+        return false;
+    }
+    if (!loadGraph(in))
+    {
+        std::cerr << "Rejecting corrupted BTPG snapshot: " << fileName << std::endl;
+        return false;
+    }
+
+    uint32_t numGroups;
+    if (!readBinary(in, numGroups))
+        return false;
+    for (uint32_t g = 0; g < numGroups; g++)
+    {
+        int32_t groupId, fromId, toId, biGroupId, earliestOut, earliestIn;
+        uint8_t flags;
+        uint32_t size;
+        if (!readBinary(in, groupId) || !readBinary(in, fromId) || !readBinary(in, toId) || !readBinary(in, biGroupId) ||
+            !readBinary(in, earliestOut) || !readBinary(in, earliestIn) || !readBinary(in, flags) || !readBinary(in, size))
+            return false;
+        Type2EdgeGroup *group = this->arena.type2EdgeGroups.create();
+        group->groupId = groupId;
+        group->fromId = fromId;
+        group->toId = toId;
+        group->biGroupId = biGroupId;
+        group->canBeReversed = flags & 1;
+        group->isBidirectional = flags & 2;
+        if (earliestOut >= getNumTypeTwoEdges() || earliestIn >= getNumTypeTwoEdges())
+            return false;
+        group->earliestOutEdge = earliestOut >= 0 ? getTypeTwoEdge(earliestOut) : nullptr;
+        group->earliestInEdge = earliestIn >= 0 ? getTypeTwoEdge(earliestIn) : nullptr;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            int32_t edgeId;
+            if (!readBinary(in, edgeId) || edgeId < 0 || edgeId >= getNumTypeTwoEdges())
+                return false;
+            group->type2Edges.push_back(getTypeTwoEdge(edgeId));
+        }
+        addType2EdgeGroup(group);
+    }
+
+    uint32_t numPairs;
+    if (!readBinary(in, numPairs))
+        return false;
+    for (uint32_t i = 0; i < numPairs; i++)
+    {
+        int32_t id, originalId, flippedId;
+        if (!readBinary(in, id) || !readBinary(in, originalId) || !readBinary(in, flippedId))
+            return false;
+        BiPair *biPair = this->arena.biPairs.create(originalId, flippedId);
+        biPair->id = id;
+        addBiPair(biPair);
+    }
+    uint32_t numGroupPairs;
+    if (!readBinary(in, numGroupPairs))
+        return false;
+    for (uint32_t i = 0; i < numGroupPairs; i++)
+    {
+        int32_t id, originalId, flippedId;
+        if (!readBinary(in, id) || !readBinary(in, originalId) || !readBinary(in, flippedId))
+            return false;
+        BiGroupPair *biGroupPair = this->arena.biGroupPairs.create(originalId, flippedId);
+        biGroupPair->id = id;
+        addBiGroupPair(biGroupPair);
+    }
+    uint32_t orderSize;
+    if (!readBinary(in, orderSize))
+        return false;
+    this->checkOrder.resize(orderSize);
+    for (auto &groupId : this->checkOrder)
+    {
+        int32_t id;
+        if (!readBinary(in, id))
+            return false;
+        groupId = id;
+    }
+    uint8_t finished, groupPass;
+    int32_t negativeCases, cursor, newPairs, singletons;
+    if (!readBinary(in, finished) || !readBinary(in, groupPass) || !readBinary(in, negativeCases) || !readBinary(in, cursor) || !readBinary(in, newPairs) ||
+        !readBinary(in, singletons))
+        return false;
+    this->groupCursor = cursor;
+    this->passNewPairs = newPairs;
+    this->type2EdgeSigleton = singletons;
+    this->finish = finished != 0;
+    this->groupPass = groupPass != 0;
+    this->naiveNegativeCase = negativeCases;
+    return true;
 }
 
 int BTPG::getNumType2EdgeGroups()
@@ -176,189 +800,635 @@ BiPair *BTPG::getBiPair(int biPairId)
     return this->BiPairs[biPairId];
 }
 
+void BTPG::addBiGroupPair(BiGroupPair *pair)
+{
+    this->BiGroupPairs.push_back(pair);
+}
+
+int BTPG::getNumBiGroupPairs()
+{
+    return this->BiGroupPairs.size();
+}
+
+BiGroupPair *BTPG::getBiGroupPair(int biGroupPairId)
+{
+    return this->BiGroupPairs[biGroupPairId];
+}
+
 // Helper functions
-void BTPG::CheckSingleton(type2Edge *candidateEdge)
+bool BTPG::CheckSingleton(type2Edge *candidateEdge)
 {
     if (candidateEdge->isBidirectional)
-        return;
-    if (CheckSingletonValidity(candidateEdge))
+        return true;
+    // edge cases
+    if (candidateEdge->nodeTo->Type1Next == NULL || candidateEdge->nodeFrom->Type1Prev->timeStep == 0)
     {
-        // set candidateEdge to be bidirectional
-        candidateEdge->isBidirectional = true;
-
-        // Add another type-2 edge
-        type2Edge *newType2Edge = new type2Edge();
-        newType2Edge->nodeFrom = candidateEdge->nodeTo;
-        newType2Edge->nodeTo = candidateEdge->nodeFrom;
-        newType2Edge->edgeId = getNumTypeTwoEdges();
-        newType2Edge->isBidirectional = true;
-        addTypeTwoEdge(newType2Edge);
-
-        // Add new edge to the node
-        candidateEdge->nodeTo->Type1Next->Type2Next.push_back(newType2Edge);
-        candidateEdge->nodeFrom->Type1Prev->Type2Prev.push_back(newType2Edge);
+        this->naiveNegativeCase++;
+        return true;
+    }
+    // none of the nodes its last search expanded changed since, so it would fail again
+    if (IsSettled(candidateEdge->edgeId))
+    {
+        this->report.settled++;
+        return true;
+    }
+    bool valid;
+    bool skipped = false; ///< decided by the reach index, without a search
+    if (this->numThreads > 1)
+    {
+        valid = CheckSpeculatedValidity(candidateEdge, skipped);
+    }
+    else
+    {
+        this->flat = &getFlatGraph();
+        skipped = !ReachesEnd(candidateEdge);
+        valid = skipped || CheckSingletonValidity(this->scratch, candidateEdge);
+    }
+    // a cancelled search decided nothing, and nothing of it is kept: the next call checks the candidate again
+    if (!skipped && this->scratch.stats.cancelled)
+    {
+        this->report.cancelled++;
+        if (!this->options.giveUpCancelled || this->cancelledGroup != candidateEdge->groupId)
+            return false;
+        // the next call started with it, so a whole call could not finish it: it is given up as at the expansion budget
+        this->scratch.stats.exhausted = true;
+        valid = false;
+    }
+    RecordCheck(candidateEdge, valid, skipped);
+    if (valid)
+    {
+        ReverseEdge(candidateEdge);
+    }
+    return true;
+}
 
-        // Add BiPair
-        BiPair *newBiPair = new BiPair(candidateEdge->edgeId, newType2Edge->edgeId);
-        newBiPair->id = getNumBiPairs();
-        addBiPair(newBiPair);
+// reverse a group of consecutive edges between two agents as a whole
+bool BTPG::CheckGroup(Type2EdgeGroup *group)
+{
+    std::vector<type2Edge *> &edges = group->type2Edges;
+    // edge cases
+    for (auto &edge : edges)
+    {
+        if (edge->nodeTo->Type1Next == NULL || edge->nodeFrom->Type1Prev->timeStep == 0)
+        {
+            this->naiveNegativeCase++;
+            return true;
+        }
+    }
+    // groups are not speculated, as there are few of them
+    this->flat = &getFlatGraph();
+    bool valid = CheckGroupValidity(this->scratch, group);
+    if (this->scratch.stats.cancelled)
+    {
+        this->report.cancelled++;
+        if (!this->options.giveUpCancelled || this->cancelledGroup != group->groupId)
+            return false;
+        this->scratch.stats.exhausted = true;
+        valid = false;
+    }
+    if (this->scratch.recordStats)
+    {
+        this->report.record(edges[0]->edgeId, group->fromId, group->toId, valid, this->scratch.stats);
+    }
+    if (valid)
+        ReverseGroup(group);
+    return true;
+}
 
-        // Update two edges
-        candidateEdge->biPairId = newBiPair->id;
-        newType2Edge->biPairId = newBiPair->id;
+// reverse every edge of a group, the reversed edges forming the flipped group
+void BTPG::ReverseGroup(Type2EdgeGroup *group)
+{
+    Type2EdgeGroup *flippedGroup = this->arena.type2EdgeGroups.create();
+    flippedGroup->groupId = getNumType2EdgeGroups();
+    flippedGroup->fromId = group->toId;
+    flippedGroup->toId = group->fromId;
+    BiGroupPair *biGroupPair = this->arena.biGroupPairs.create(group->groupId, flippedGroup->groupId);
+    biGroupPair->id = getNumBiGroupPairs();
+    addBiGroupPair(biGroupPair);
+    for (auto &edge : group->type2Edges)
+    {
+        type2Edge *newType2Edge = ReverseEdge(edge);
+        newType2Edge->isGrouped = true;
+        newType2Edge->groupId = flippedGroup->groupId;
+        flippedGroup->type2Edges.push_back(newType2Edge);
+        for (type2Edge *pairEdge : {edge, newType2Edge})
+        {
+            pairEdge->isGroupedBidirectional = true;
+            pairEdge->biGroupId = biGroupPair->id;
+        }
+    }
+    for (Type2EdgeGroup *pairGroup : {group, flippedGroup})
+    {
+        pairGroup->canBeReversed = true;
+        pairGroup->isBidirectional = true;
+        pairGroup->biGroupId = biGroupPair->id;
     }
-    return;
+    addType2EdgeGroup(flippedGroup);
 }
 
-bool BTPG::CheckSingletonValidity(type2Edge *candidateEdge)
+// count a check, and keep a failed one of BTPG-o until a node its search expanded changes
+void BTPG::RecordCheck(type2Edge *candidateEdge, bool valid, bool skipped)
 {
-    // std::cout << candidateEdge->nodeFrom->robotId << " " << candidateEdge->nodeFrom->timeStep << " -> " << candidateEdge->nodeTo->robotId << " " << candidateEdge->nodeTo->timeStep << std::endl;
-    // 1. Initialization
-    // 1a. Initialize the start and end nodes
-    Node *startNode = candidateEdge->nodeFrom->Type1Prev;
-    Node *endNode = candidateEdge->nodeTo->Type1Next;
-    // edge cases
-    if (endNode == NULL || startNode->timeStep == 0)
+    // reachability only grows as BiPairs are added, so an index that stopped skipping searches is dropped
+    if (skipped)
     {
-        this->naiveNegativeCase++;
-        return false;
+        this->reachMisses = 0;
+        this->report.unreachable++;
+    }
+    else if (this->reach.isBuilt() && ++this->reachMisses > reachIndexMaxMisses)
+    {
+        this->reach.clear();
     }
+    if (!skipped && this->scratch.recordStats)
+    {
+        this->report.record(candidateEdge->edgeId, candidateEdge->nodeFrom->robotId, candidateEdge->nodeTo->robotId, valid, this->scratch.stats);
+    }
+    if (!valid && this->mode == 1)
+    {
+        Settle(candidateEdge->edgeId, this->scratch.expanded);
+    }
+}
 
-    // Temporarily set the edge to be bidirectional
+// make an edge bidirectional by adding its reversed edge and their BiPair
+type2Edge *BTPG::ReverseEdge(type2Edge *candidateEdge)
+{
+    // set candidateEdge to be bidirectional
     candidateEdge->isBidirectional = true;
-    // Temporarily add a new edge to type-2 edge
-    type2Edge *newType2Edge = new type2Edge();
-    newType2Edge->nodeFrom = endNode;
-    newType2Edge->nodeTo = startNode;
+
+    // Add another type-2 edge
+    type2Edge *newType2Edge = this->arena.type2Edges.create();
+    newType2Edge->nodeFrom = candidateEdge->nodeTo;
+    newType2Edge->nodeTo = candidateEdge->nodeFrom;
     newType2Edge->edgeId = getNumTypeTwoEdges();
     newType2Edge->isBidirectional = true;
     addTypeTwoEdge(newType2Edge);
 
-    // 1b. Initialize the visit stacks for nodes
-    std::set<Node *> visitedNodes;
+    // Add new edge to the node
+    linkTypeTwoEdge(newType2Edge, candidateEdge->nodeTo->Type1Next, candidateEdge->nodeFrom->Type1Prev);
 
-    // 1b'. Initialize the visit stacks for current node
-    Node *setVisitedNode = endNode->Type1Prev;
-    while (setVisitedNode != NULL)
+    // Add BiPair
+    BiPair *newBiPair = this->arena.biPairs.create(candidateEdge->edgeId, newType2Edge->edgeId);
+    newBiPair->id = getNumBiPairs();
+    addBiPair(newBiPair);
+
+    // Update two edges
+    candidateEdge->biPairId = newBiPair->id;
+    newType2Edge->biPairId = newBiPair->id;
+
+    // Keep the order of the other visits of the cell in a reduced TPG
+    connectBypassEdges(candidateEdge);
+
+    // the reach index reads the incoming edges of the flat view
+    this->flat = &getFlatGraph();
+
+    // the outgoing edges of these nodes changed
+    NodeChanged(candidateEdge->nodeFrom->nodeId);
+    for (int e = newType2Edge->edgeId; e < getNumTypeTwoEdges(); e++)
     {
-        visitedNodes.insert(setVisitedNode);
-        setVisitedNode = setVisitedNode->Type1Prev;
+        Node *linkedAt = e == newType2Edge->edgeId ? candidateEdge->nodeTo->Type1Next : getTypeTwoEdge(e)->nodeFrom;
+        NodeChanged(linkedAt->nodeId);
+        if (this->numThreads > 1)
+            this->changedInMarks[getTypeTwoEdge(e)->nodeTo->nodeId] = this->speculationRound;
+        // a deadline in the middle of the update drops the index, which only saves searches
+        if (this->reach.isBuilt())
+            this->reach.addEdge(linkedAt->nodeId, getTypeTwoEdge(e)->nodeTo->nodeId, this->scratch.cancel);
     }
+    return newType2Edge;
+}
 
-    // 1c. Initialize the stacks for revisit nodes
-    std::vector<std::set<Node *>> revisitNodes;
-    for (int i = 0; i < getNumTypeTwoEdges(); i++)
+// a node's outgoing edges changed, which invalidates the checks whose search expanded it
+void BTPG::NodeChanged(int node)
+{
+    if (this->numThreads > 1)
+        this->changedMarks[node] = this->speculationRound;
+    if (node < (int)this->watchers.size())
     {
-        std::set<Node *> temp;
-        revisitNodes.push_back(temp);
+        for (auto &watcher : this->watchers[node])
+        {
+            if (this->settleVersions[watcher.first] == watcher.second)
+                this->settled[watcher.first] = false;
+        }
+        this->watchers[node].clear();
     }
+}
 
-    // 1d. stack for current recursion path
-    std::vector<Node *> recursionPath;
-    std::set<Node *> recursionPathSet;
+// record that a candidate failed, until a node its search expanded changes
+void BTPG::Settle(int edgeId, std::vector<int> &expanded)
+{
+    if ((int)this->settled.size() <= edgeId)
+    {
+        this->settled.resize(getNumTypeTwoEdges(), false);
+        this->settleVersions.resize(getNumTypeTwoEdges(), 0);
+    }
+    if (this->watchers.empty())
+    {
+        this->watchers.resize(getFlatGraph().getNumNodes());
+        this->watchMarks.resize(getFlatGraph().getNumNodes(), 0);
+    }
+    this->settled[edgeId] = true;
+    uint32_t version = ++this->settleVersions[edgeId];
+    // a search can expand a node several times
+    this->watchEpoch++;
+    for (auto &node : expanded)
+    {
+        if (this->watchMarks[node] == this->watchEpoch)
+            continue;
+        this->watchMarks[node] = this->watchEpoch;
+        this->watchers[node].push_back(std::make_pair(edgeId, version));
+    }
+}
 
-    // 1e. stack for edges in the current recursion path
-    std::set<int> recursionEdgePath;
+bool BTPG::IsSettled(int edgeId)
+{
+    return edgeId < (int)this->settled.size() && this->settled[edgeId];
+}
 
-    // 1f. dictionary for agents that how to get to the end node
-    std::unordered_map<int, int> agentEdgeMap;
-    for (int i = 0; i < getNumAgents(); i++)
+// the validity of a candidate from the current speculation round, checked again if an earlier commit could change it
+bool BTPG::CheckSpeculatedValidity(type2Edge *candidateEdge, bool &skipped)
+{
+    if (this->speculationNext == this->speculation.size() || this->speculation[this->speculationNext].edgeId != candidateEdge->edgeId)
+        Speculate();
+    SpeculativeCheck &check = this->speculation[this->speculationNext++];
+    if (check.stats.cancelled)
+    {
+        // checked again, and cancelled again unless the token was replaced
+        this->flat = &getFlatGraph();
+        return CheckSingletonValidity(this->scratch, candidateEdge);
+    }
+    if (check.unreachable)
+    {
+        // decided by the reach index, which the commits of the round may have changed
+        skipped = !ReachesEnd(candidateEdge);
+        if (skipped)
+            return true;
+        this->flat = &getFlatGraph();
+        return CheckSingletonValidity(this->scratch, candidateEdge);
+    }
+    for (auto &node : check.expanded)
     {
-        agentEdgeMap[i] = -1;
+        if (this->changedMarks[node] == this->speculationRound)
+        {
+            this->flat = &getFlatGraph();
+            return CheckSingletonValidity(this->scratch, candidateEdge);
+        }
     }
+    for (auto &node : check.entered)
+    {
+        if (this->changedInMarks[node] == this->speculationRound)
+        {
+            this->flat = &getFlatGraph();
+            return CheckSingletonValidity(this->scratch, candidateEdge);
+        }
+    }
+    // the expanded nodes and counters of the last check are kept in the scratch state
+    this->scratch.expanded.swap(check.expanded);
+    this->scratch.stats = check.stats;
+    return check.valid;
+}
 
-    // 1g. dictionary for agents that how to leave to the end node
-    std::unordered_map<int, int> agentEdgeMapLeave;
-    for (int i = 0; i < getNumAgents(); i++)
+// check the next singletons of the current pass in parallel, against the graph as it is now
+void BTPG::Speculate()
+{
+    // the candidates the serial loop would check next, in its order
+    std::vector<type2Edge *> candidates;
+    size_t batchSize = 8 * this->numThreads;
+    for (int i = this->groupCursor; i < getNumType2EdgeGroups() && candidates.size() < batchSize; i++)
     {
-        agentEdgeMapLeave[i] = -1;
+        Type2EdgeGroup *group = GroupAt(i);
+        if (group->type2Edges.size() > 1)
+            continue;
+        type2Edge *edge = group->type2Edges[0];
+        if (edge->isBidirectional || edge->nodeTo->Type1Next == NULL || edge->nodeFrom->Type1Prev->timeStep == 0 || IsSettled(edge->edgeId))
+            continue;
+        candidates.push_back(edge);
     }
 
-    agentEdgeMap[startNode->robotId] = candidateEdge->edgeId;
-    // std::cout << "StartNode: " << startNode->robotId << " " << startNode->timeStep << std::endl;
-    // check if the startnode has a type-2 neighbor is 12 99
-    // for (auto &edge : startNode->Type2Next)
-    // {
-    //     std::cout << "edge: " << edge->nodeTo->robotId << " " << edge->nodeTo->timeStep << std::endl;
-    // }
-
-    agentEdgeMap[startNode->robotId] = newType2Edge->edgeId;
-    // 2. Start the search
-    if (BidirectionalDFS(startNode, endNode, visitedNodes, revisitNodes, recursionPath, recursionPathSet, agentEdgeMap, agentEdgeMapLeave, false))
-    {
-        candidateEdge->isBidirectional = false;
-        // delete the new edge
-        removeTypeTwoEdge(newType2Edge);
-        delete newType2Edge;
-        return false;
+    this->speculationRound++;
+    this->speculationNext = 0;
+    this->speculation.assign(candidates.size(), SpeculativeCheck());
+    this->flat = &getFlatGraph();
+    int numWorkers = std::min<int>(this->numThreads, candidates.size());
+    if ((int)this->workerScratch.size() < numWorkers)
+        this->workerScratch.resize(numWorkers);
+
+    // workers only read the graph; each one searches with its own scratch state
+    std::atomic<size_t> nextCandidate(0);
+    auto worker = [&](int w)
+    {
+        SearchScratch &scratch = this->workerScratch[w];
+        scratch.recordExpanded = true;
+        scratch.maxExpansions = this->scratch.maxExpansions;
+        scratch.recordStats = this->scratch.recordStats;
+        scratch.cancel = this->scratch.cancel;
+        for (size_t c = nextCandidate++; c < candidates.size(); c = nextCandidate++)
+        {
+            SpeculativeCheck &check = this->speculation[c];
+            check.edgeId = candidates[c]->edgeId;
+            check.unreachable = !ReachesEnd(candidates[c]);
+            if (check.unreachable)
+            {
+                check.valid = true;
+                check.expanded.clear();
+                continue;
+            }
+            check.valid = CheckSingletonValidity(scratch, candidates[c]);
+            check.expanded.swap(scratch.expanded);
+            check.entered.swap(scratch.entered);
+            check.stats = scratch.stats;
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int w = 1; w < numWorkers; w++)
+    {
+        threads.emplace_back(worker, w);
     }
-    else
+    worker(0);
+    for (auto &thread : threads)
     {
-        candidateEdge->isBidirectional = false;
-        // delete the new edge
-        removeTypeTwoEdge(newType2Edge);
-        delete newType2Edge;
+        thread.join();
+    }
+}
+
+// false if the reach index shows that no path leads from the start to the end node of the candidate's search
+bool BTPG::ReachesEnd(type2Edge *candidateEdge)
+{
+    if (!this->reach.isBuilt())
         return true;
+    return this->reach.canReachByType2(candidateEdge->nodeFrom->Type1Prev->nodeId, candidateEdge->nodeTo->Type1Next->nodeId);
+}
+
+// search for a cycle closed by reversing the candidate, without changing the graph
+bool BTPG::CheckSingletonValidity(SearchScratch &scratch, type2Edge *candidateEdge)
+{
+    // std::cout << candidateEdge->nodeFrom->robotId << " " << candidateEdge->nodeFrom->timeStep << " -> " << candidateEdge->nodeTo->robotId << " " << candidateEdge->nodeTo->timeStep << std::endl;
+    // 1. Initialization
+    // 1a. Initialize the start and end nodes
+    Node *startNode = candidateEdge->nodeFrom->Type1Prev;
+    Node *endNode = candidateEdge->nodeTo->Type1Next;
+
+    // 1b. Start a new search in the scratch state, with the path of the end agent before the end node visited
+    // the candidate counts as bidirectional, and the reversed edge is a probe edge that exists only in the scratch state
+    scratch.begin(*this->flat, getNumAgents(), getNumTypeTwoEdges() + 1, endNode->nodeId);
+    scratch.candidateEdgeId = candidateEdge->edgeId;
+    scratch.probeEdge = type2Edge();
+    scratch.probeEdge.nodeFrom = endNode;
+    scratch.probeEdge.nodeTo = startNode;
+    scratch.probeEdge.edgeId = getNumTypeTwoEdges();
+    scratch.probeEdge.isBidirectional = true;
+
+    // 1c. the start agent is entered through the probe edge
+    // std::cout << "StartNode: " << startNode->robotId << " " << startNode->timeStep << std::endl;
+    scratch.agentEdge(startNode->robotId) = scratch.probeEdge.edgeId;
+    // 2. Start the search, unless no path at all leads from the start to the end node
+    std::chrono::steady_clock::time_point start;
+    if (scratch.recordStats)
+        start = std::chrono::steady_clock::now();
+    bool valid = (this->options.meetInMiddle && !FrontiersMeet(scratch, startNode->nodeId, endNode->nodeId)) ||
+                 !BidirectionalDFS(scratch, startNode->nodeId, endNode->nodeId, false);
+    if (scratch.recordStats)
+        scratch.stats.micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return valid;
+}
+
+// once an agent passes a reversed group first, the other one waits at each of its edges for the first agent to reach it;
+// the first agent may then still be far from the later edges, which the singleton search does not model, so a group is only
+// reversed if no chain of waits the simulation can enforce leads back from its later nodeTo to the nodes before its nodeFrom,
+// with both directions of every bidirectional edge taken as a wait
+bool BTPG::CheckGroupValidity(SearchScratch &scratch, Type2EdgeGroup *group)
+{
+    const FlatGraph &flat = *this->flat;
+    std::vector<type2Edge *> &edges = group->type2Edges;
+    int startNode = edges[0]->nodeFrom->Type1Prev->nodeId;
+    int firstTo = edges[0]->nodeTo->nodeId;
+    int lastTo = firstTo;
+    for (auto &edge : edges)
+    {
+        startNode = std::min(startNode, edge->nodeFrom->Type1Prev->nodeId);
+        firstTo = std::min(firstTo, edge->nodeTo->nodeId);
+        lastTo = std::max(lastTo, edge->nodeTo->nodeId);
+    }
+    // the agent that claims the group at its first nodeTo has already passed it and the nodes before it
+    scratch.begin(flat, getNumAgents(), getNumTypeTwoEdges() + 1, firstTo + 1);
+    int startLast = flat.agentOffsets[group->fromId + 1];
+    std::chrono::steady_clock::time_point start;
+    if (scratch.recordStats)
+        start = std::chrono::steady_clock::now();
+
+    std::vector<int> &backward = scratch.backwardQueue;
+    backward.clear();
+    bool waits = false;
+    auto step = [&](int node)
+    {
+        if (scratch.isBlocked(node) || scratch.backwardMarks[node] == scratch.epoch)
+            return;
+        waits = waits || (node >= startNode && node < startLast);
+        scratch.backwardMarks[node] = scratch.epoch;
+        backward.push_back(node);
+    };
+    for (int node = firstTo + 1; node <= lastTo; node++)
+    {
+        step(node);
+    }
+    for (size_t next = 0; !waits && next < backward.size(); next++)
+    {
+        if (scratch.stopRequested())
+            return false;
+        int node = backward[next];
+        scratch.stats.expanded++;
+        for (uint32_t k = flat.type2PrevOffsets[node]; k < flat.type2PrevOffsets[node + 1]; k++)
+        {
+            // the original edges of the group bind the second agent only
+            if (getTypeTwoEdge(flat.type2PrevEdges[k])->groupId != group->groupId)
+                step(flat.type2PrevNodes[k]);
+        }
+        if (flat.getType1Prev(node) != -1)
+            step(flat.getType1Prev(node));
     }
+    if (scratch.recordStats)
+        scratch.stats.micros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    return !waits;
 }
 
-bool BTPG::BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &VisitedStack_, std::vector<std::set<Node *>> &RevisitedNodes_, std::vector<Node *> &RecursionPath_, std::set<Node *> &RecursionPathSet_,
-                            std::unordered_map<int, int> &AgentEdgeMap_, std::unordered_map<int, int> &AgentEdgeMapLeave_, bool hasTYpe1Edge_)
+// grow a frontier forward from the start node and one backward from the end node, always the smaller one,
+// over every edge the search could follow; the search only adds restrictions to these paths, so if one frontier
+// runs out before they meet it cannot find a cycle either
+bool BTPG::FrontiersMeet(SearchScratch &scratch, int startNode_, int endNode_)
 {
-    // std::cout << "currNode: " << currNode_->robotId << " " << currNode_->timeStep << std::endl;
+    const FlatGraph &flat = *this->flat;
+    std::vector<int> &forward = scratch.forwardQueue;
+    std::vector<int> &backward = scratch.backwardQueue;
+    forward.assign(1, startNode_);
+    backward.assign(1, endNode_);
+    scratch.forwardMarks[startNode_] = scratch.epoch;
+    scratch.backwardMarks[endNode_] = scratch.epoch;
+    size_t forwardNext = 0;
+    size_t backwardNext = 0;
+    bool met = false;
+    // the search never enters the path of the end agent before the end node
+    auto stepForward = [&](int node)
+    {
+        if (scratch.isBlocked(node) || scratch.forwardMarks[node] == scratch.epoch)
+            return;
+        met = met || scratch.backwardMarks[node] == scratch.epoch;
+        scratch.forwardMarks[node] = scratch.epoch;
+        forward.push_back(node);
+    };
+    auto stepBackward = [&](int node)
+    {
+        if (scratch.isBlocked(node) || scratch.backwardMarks[node] == scratch.epoch)
+            return;
+        met = met || scratch.forwardMarks[node] == scratch.epoch;
+        scratch.backwardMarks[node] = scratch.epoch;
+        backward.push_back(node);
+    };
+
+    while (!met && forwardNext < forward.size() && backwardNext < backward.size())
+    {
+        // the search that follows stops at once as well
+        if (scratch.stopRequested())
+            return true;
+        scratch.stats.probed++;
+        if (forward.size() - forwardNext <= backward.size() - backwardNext)
+        {
+            int node = forward[forwardNext++];
+            if (scratch.recordExpanded)
+                scratch.expanded.push_back(node);
+            for (uint32_t k = flat.type2NextOffsets[node]; k < flat.type2NextOffsets[node + 1]; k++)
+                stepForward(flat.type2NextNodes[k]);
+            if (flat.getType1Next(node) != -1)
+                stepForward(flat.getType1Next(node));
+        }
+        else
+        {
+            int node = backward[backwardNext++];
+            if (scratch.recordExpanded)
+                scratch.entered.push_back(node);
+            for (uint32_t k = flat.type2InOffsets[node]; k < flat.type2InOffsets[node + 1]; k++)
+                stepBackward(flat.type2InNodes[k]);
+            if (flat.getType1Prev(node) != -1)
+                stepBackward(flat.getType1Prev(node));
+        }
+    }
+    if (met)
+    {
+        // the search decides, and its result only depends on the nodes it expands
+        scratch.expanded.clear();
+        scratch.entered.clear();
+    }
+    return met;
+}
+
+// an edge seen by the search, which can be the probe edge of the scratch state
+type2Edge *BTPG::SearchEdge(SearchScratch &scratch, int edgeId)
+{
+    return edgeId == scratch.probeEdge.edgeId ? &scratch.probeEdge : getTypeTwoEdge(edgeId);
+}
+
+// enter a node of the search: 1 if it closes a cycle through the candidate, 0 if it is the end node without a cycle, 2 if it was pushed
+int BTPG::EnterSearchNode(SearchScratch &scratch, int node_, int endNode_, bool hasTYpe1Edge_)
+{
+    std::vector<int> &RecursionPath_ = scratch.recursionPath;
     // !: Base Case
     // 1. check if reach the end node
-    if (currNode_ == endNode_)
+    if (node_ == endNode_)
     {
         if (hasTYpe1Edge_ || RecursionPath_.size() > 2)
         {
-            // print out the recursion path
-            // std::cout << "Recursion Path: ";
-            // for (auto &node : RecursionPath_)
-            // {
-            //     std::cout << node->robotId << " " << node->timeStep << " -> ";
-            // }
-            // std::cout << std::endl;
-            // std::cout << "endNode: " << endNode_->robotId << " " << endNode_->timeStep << std::endl;
-            return true;
+            return 1;
         }
-        else
+        // revisit all the nodes in the recursion path
+        for (auto node = RecursionPath_.rbegin(); node != RecursionPath_.rend() - 1; node++)
         {
-            // revisit all the nodes in the recursion path
-            for (auto node = RecursionPath_.rbegin(); node != RecursionPath_.rend() - 1; node++)
-            {
-                // ??: should set unvisit directly
-                VisitedStack_.erase(*node);
-            }
-            return false;
+            // ??: should set unvisit directly
+            scratch.setUnvisited(*node);
         }
+        return 0;
+    }
+
+    // a search over its budget gives up as if it found a cycle, which only loses the candidate
+    if (scratch.maxExpansions != 0 && scratch.stats.expanded >= scratch.maxExpansions)
+    {
+        scratch.stats.exhausted = true;
+        return 1;
     }
+    // a cancelled search gives up the same way, but its check is then discarded
+    if (scratch.stopRequested())
+        return 1;
 
     // Update
-    VisitedStack_.insert(currNode_);
-    RecursionPath_.push_back(currNode_);
-    RecursionPathSet_.insert(currNode_);
+    scratch.setVisited(node_);
+    scratch.pushPath(node_);
+    scratch.stats.expanded++;
+    scratch.stats.maxDepth = std::max<uint32_t>(scratch.stats.maxDepth, RecursionPath_.size());
+    if (scratch.recordExpanded)
+        scratch.expanded.push_back(node_);
+    scratch.frames.push_back(SearchFrame{node_, this->flat->type2NextOffsets[node_], -1, hasTYpe1Edge_, false});
+    return 2;
+}
 
-    // !: Traverse Type-2 Edge
-    for (auto &edge : currNode_->Type2Next)
+// undo the agent maps and the visits of a type-2 edge once the search has backtracked over it
+void BTPG::LeaveSearchEdge(SearchScratch &scratch, int currNode_, uint32_t k)
+{
+    const FlatGraph &flat = *this->flat;
+    int toRobotId = flat.robotIds[flat.type2NextNodes[k]];
+    if (toRobotId != -1)
     {
-        // 2. Checking if need to keep going on
-        if (VisitedStack_.find(edge->nodeTo) == VisitedStack_.end() && RecursionPathSet_.find(edge->nodeTo) == RecursionPathSet_.end())
+        // 2b.3: update agentEdgeMap (leave), without the edge in the recursion path
+        scratch.agentEdge(toRobotId) = -1;
+    }
+    // 2b.4: update agentEdgeMap (leave), without the edge in the recursion path
+    scratch.agentLeaveEdge(flat.robotIds[currNode_]) = -1;
+
+    // revisit relevant nodes
+    std::vector<int> &revisitNodes = scratch.revisits(flat.type2NextEdges[k]);
+    for (auto &node : revisitNodes)
+    {
+        scratch.setUnvisited(node);
+    }
+    revisitNodes.clear();
+}
+
+// depth-first search over an explicit frame stack, true if it finds a cycle through the candidate edge
+bool BTPG::BidirectionalDFS(SearchScratch &scratch, int startNode_, int endNode_, bool hasTYpe1Edge_)
+{
+    const FlatGraph &flat = *this->flat;
+    std::vector<int> &RecursionPath_ = scratch.recursionPath;
+    std::vector<SearchFrame> &frames = scratch.frames;
+    frames.clear();
+    if (EnterSearchNode(scratch, startNode_, endNode_, hasTYpe1Edge_) == 1)
+        return true;
+
+    while (!frames.empty())
+    {
+        SearchFrame &frame = frames.back();
+        int currNode_ = frame.node;
+        int currRobotId = flat.robotIds[currNode_];
+
+        // !: Traverse Type-2 Edge
+        if (frame.nextEdge < flat.type2NextOffsets[currNode_ + 1])
         {
+            uint32_t k = frame.nextEdge++;
+            type2Edge *edge = getTypeTwoEdge(flat.type2NextEdges[k]);
+            int nodeTo = flat.type2NextNodes[k];
+            int toRobotId = flat.robotIds[nodeTo];
+            // 2. Checking if need to keep going on
+            if (!scratch.canVisit(nodeTo))
+                continue;
+
             // Need keep visiting next node
             // 2a. if so, checking if the edge is bidirectional
-            if (edge->isBidirectional)
+            if (edge->isBidirectional || edge->edgeId == scratch.candidateEdgeId)
             {
-                if (this->mode == 0 && AgentEdgeMap_[currNode_->robotId] != -1)
+                if (this->mode == 0 && scratch.agentEdge(currRobotId) != -1)
                 {
                     // Only check if the previous edge is the same bidirectional edge
-                    Node *prevNode = getTypeTwoEdge(AgentEdgeMap_[currNode_->robotId])->nodeTo;
-                    if (edge->biPairId == getTypeTwoEdge(AgentEdgeMap_[currNode_->robotId])->biPairId)
+                    int prevNode = SearchEdge(scratch, scratch.agentEdge(currRobotId))->nodeTo->nodeId;
+                    if (edge->biPairId == SearchEdge(scratch, scratch.agentEdge(currRobotId))->biPairId)
                     {
                         // !: if reach current Node by a type-1 edge, then we should only revisit current node
-                        if (RecursionPath_.back()->robotId == currNode_->robotId)
+                        if (flat.robotIds[RecursionPath_.back()] == currRobotId)
                         {
-                            RevisitedNodes_[AgentEdgeMap_[currNode_->robotId]].insert(currNode_);
+                            scratch.addRevisit(scratch.agentEdge(currRobotId), currNode_);
                         }
                         else
                         {
@@ -366,7 +1436,7 @@ bool BTPG::BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &V
                             // !then we should revisit all the nodes in the recursion path back to the prevNode
                             for (auto renode = RecursionPath_.rbegin(); renode != RecursionPath_.rend(); renode++)
                             {
-                                RevisitedNodes_[AgentEdgeMap_[currNode_->robotId]].insert(*renode);
+                                scratch.addRevisit(scratch.agentEdge(currRobotId), *renode);
                                 if (*renode == prevNode)
                                 {
                                     break;
@@ -377,19 +1447,17 @@ bool BTPG::BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &V
                     }
                 }
                 // 2a.1: Check if we should visit the edge (BTPG-o)
-                if (this->mode == 1 && AgentEdgeMap_[currNode_->robotId] != -1)
+                if (this->mode == 1 && scratch.agentEdge(currRobotId) != -1)
                 {
                     // Have visited the same agent
-                    // std::cout << "current number of type-2:" << getNumTypeTwoEdges() << std::endl;
-                    // std::cout << "current number of type-2:" << AgentEdgeMap_[currNode_->robotId] << std::endl;
-                    Node *prevNode = getTypeTwoEdge(AgentEdgeMap_[currNode_->robotId])->nodeTo;
+                    Node *prevNode = SearchEdge(scratch, scratch.agentEdge(currRobotId))->nodeTo;
                     // 2a.1.1: Check if prevNode is in the same robot's path and has smaller time step
-                    if (prevNode->timeStep < currNode_->timeStep)
+                    if (prevNode->timeStep < flat.timeSteps[currNode_])
                     {
                         // !: if reach current Node by a type-1 edge, then we should only revisit current node
-                        if (RecursionPath_.back()->robotId == currNode_->robotId)
+                        if (flat.robotIds[RecursionPath_.back()] == currRobotId)
                         {
-                            RevisitedNodes_[AgentEdgeMap_[currNode_->robotId]].insert(currNode_);
+                            scratch.addRevisit(scratch.agentEdge(currRobotId), currNode_);
                         }
                         else
                         {
@@ -397,8 +1465,8 @@ bool BTPG::BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &V
                             // !then we should revisit all the nodes in the recursion path back to the prevNode
                             for (auto renode = RecursionPath_.rbegin(); renode != RecursionPath_.rend(); renode++)
                             {
-                                RevisitedNodes_[AgentEdgeMap_[currNode_->robotId]].insert(*renode);
-                                if (*renode == prevNode)
+                                scratch.addRevisit(scratch.agentEdge(currRobotId), *renode);
+                                if (*renode == prevNode->nodeId)
                                 {
                                     break;
                                 }
@@ -411,16 +1479,16 @@ bool BTPG::BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &V
             }
 
             // 2a.2: Check if we should visit the edge (BTPG-o)
-            if (this->mode == 1 && AgentEdgeMapLeave_[edge->nodeTo->robotId] != -1)
+            if (this->mode == 1 && scratch.agentLeaveEdge(toRobotId) != -1)
             {
-                type2Edge *prevEdge = getTypeTwoEdge(AgentEdgeMapLeave_[edge->nodeTo->robotId]);
+                type2Edge *prevEdge = SearchEdge(scratch, scratch.agentLeaveEdge(toRobotId));
                 Node *prevFromNode = prevEdge->nodeFrom;
-                if (prevFromNode->timeStep > edge->nodeTo->timeStep && prevEdge->isBidirectional)
+                if (prevFromNode->timeStep > flat.timeSteps[nodeTo] && (prevEdge->isBidirectional || prevEdge->edgeId == scratch.candidateEdgeId))
                 {
                     for (auto renode = RecursionPath_.rbegin(); renode != RecursionPath_.rend(); renode++)
                     {
-                        RevisitedNodes_[AgentEdgeMapLeave_[edge->nodeTo->robotId]].insert(*renode);
-                        if (*renode == prevEdge->nodeTo)
+                        scratch.addRevisit(scratch.agentLeaveEdge(toRobotId), *renode);
+                        if (*renode == prevEdge->nodeTo->nodeId)
                         {
                             break;
                         }
@@ -430,59 +1498,51 @@ bool BTPG::BidirectionalDFS(Node *currNode_, Node *endNode_, std::set<Node *> &V
             }
 
             // 2b. keep visiting next node
-
-            if (edge->nodeTo->robotId != -1)
+            if (toRobotId != -1)
             {
                 // 2b.1: update agentEdgeMap (enter)
-                AgentEdgeMap_[edge->nodeTo->robotId] = edge->edgeId;
+                scratch.agentEdge(toRobotId) = edge->edgeId;
             }
             // 2b.2: update agentEdgeMap (leave)
-            AgentEdgeMapLeave_[currNode_->robotId] = edge->edgeId;
+            scratch.agentLeaveEdge(currRobotId) = edge->edgeId;
 
-            // !: c.Recursion
-            if (BidirectionalDFS(edge->nodeTo, endNode_, VisitedStack_, RevisitedNodes_, RecursionPath_, RecursionPathSet_, AgentEdgeMap_, AgentEdgeMapLeave_, hasTYpe1Edge_))
-            {
+            // !: c.Descend, the edge is left when the child frame is popped
+            frame.pendingEdge = k;
+            int entered = EnterSearchNode(scratch, nodeTo, endNode_, frame.hasType1Edge);
+            if (entered == 1)
                 return true;
-            }
-
-            if (edge->nodeTo->robotId != -1)
+            if (entered == 0)
             {
-                // 2b.3: update agentEdgeMap (leave), without the edge in the recursion path
-                AgentEdgeMap_[edge->nodeTo->robotId] = -1;
+                frames.back().pendingEdge = -1;
+                LeaveSearchEdge(scratch, currNode_, k);
             }
-            // 2b.4: update agentEdgeMap (leave), without the edge in the recursion path
-            AgentEdgeMapLeave_[currNode_->robotId] = -1;
+            continue;
+        }
 
-            // revisit relevant nodes
-            for (auto &node : RevisitedNodes_[edge->edgeId])
+        // !: Traverse Type-1 Edge
+        if (!frame.type1Done)
+        {
+            frame.type1Done = true;
+            int type1Next = flat.getType1Next(currNode_);
+            // 1. check if need to keep going on
+            if (type1Next != -1 && scratch.canVisit(type1Next))
             {
-                VisitedStack_.erase(node);
+                // !: c.Descend
+                if (EnterSearchNode(scratch, type1Next, endNode_, true) == 1)
+                    return true;
             }
-            RevisitedNodes_[edge->edgeId].clear();
-        }
-        else
-        {
             continue;
         }
-    }
 
-    // !: Traverse Type-1 Edge
-    if (currNode_->Type1Next != NULL)
-    {
-        // 1. check if need to keep going on
-        if (VisitedStack_.find(currNode_->Type1Next) == VisitedStack_.end() && RecursionPathSet_.find(currNode_->Type1Next) == RecursionPathSet_.end())
+        // Update
+        scratch.popPath();
+        frames.pop_back();
+        if (!frames.empty() && frames.back().pendingEdge != -1)
         {
-            // !: c.Recursion
-            if (BidirectionalDFS(currNode_->Type1Next, endNode_, VisitedStack_, RevisitedNodes_, RecursionPath_, RecursionPathSet_, AgentEdgeMap_, AgentEdgeMapLeave_, true))
-            {
-                return true;
-            }
+            LeaveSearchEdge(scratch, frames.back().node, frames.back().pendingEdge);
+            frames.back().pendingEdge = -1;
         }
     }
 
-    // Update
-    RecursionPath_.pop_back();
-    RecursionPathSet_.erase(currNode_);
-
     return false;
-}
\ No newline at end of file
+}
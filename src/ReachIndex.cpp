@@ -0,0 +1,162 @@
+#include "ReachIndex.hpp"
+
+#include <algorithm>
+
+bool ReachIndex::build(const FlatGraph &flat, size_t maxBytes)
+{
+    this->built = false;
+    this->flat = &flat;
+    this->numNodes = flat.getNumNodes();
+    this->numAgents = flat.agentOffsets.size() - 1;
+    if ((size_t)this->numNodes * this->numAgents * sizeof(uint16_t) > maxBytes)
+        return false;
+    for (int r = 0; r < this->numAgents; r++)
+    {
+        if (flat.getPathLength(r) >= unreachable)
+            return false;
+    }
+    this->earliest.assign((size_t)this->numNodes * this->numAgents, unreachable);
+
+    // Tarjan's algorithm over an explicit stack; components are completed in reverse topological order
+    struct Frame
+    {
+        int node;
+        uint32_t nextEdge;
+        bool type1Done;
+    };
+    std::vector<int> index(this->numNodes, -1);
+    std::vector<int> low(this->numNodes, 0);
+    std::vector<int> component(this->numNodes, -1);
+    std::vector<bool> onStack(this->numNodes, false);
+    std::vector<int> stack;
+    std::vector<Frame> frames;
+    std::vector<uint16_t> componentRow(this->numAgents);
+    int counter = 0;
+    int numComponents = 0;
+    for (int root = 0; root < this->numNodes; root++)
+    {
+        if (index[root] != -1)
+            continue;
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        onStack[root] = true;
+        frames.push_back(Frame{root, flat.type2NextOffsets[root], false});
+        while (!frames.empty())
+        {
+            Frame &frame = frames.back();
+            int node = frame.node;
+            int next;
+            if (frame.nextEdge < flat.type2NextOffsets[node + 1])
+            {
+                next = flat.type2NextNodes[frame.nextEdge++];
+            }
+            else if (!frame.type1Done)
+            {
+                frame.type1Done = true;
+                next = flat.getType1Next(node);
+                if (next == -1)
+                    continue;
+            }
+            else
+            {
+                // every successor is done
+                frames.pop_back();
+                if (!frames.empty())
+                    low[frames.back().node] = std::min(low[frames.back().node], low[node]);
+                if (low[node] != index[node])
+                    continue;
+
+                // pop the component, whose successors outside of it all have their rows
+                auto first = std::find(stack.rbegin(), stack.rend(), node).base() - 1;
+                for (auto it = first; it != stack.end(); it++)
+                {
+                    component[*it] = numComponents;
+                    onStack[*it] = false;
+                }
+                std::fill(componentRow.begin(), componentRow.end(), unreachable);
+                for (auto it = first; it != stack.end(); it++)
+                {
+                    int member = *it;
+                    uint16_t &own = componentRow[flat.robotIds[member]];
+                    own = std::min<uint16_t>(own, flat.timeSteps[member]);
+                    int type1Next = flat.getType1Next(member);
+                    if (type1Next != -1 && component[type1Next] != numComponents)
+                    {
+                        const uint16_t *other = row(type1Next);
+                        for (int i = 0; i < this->numAgents; i++)
+                            componentRow[i] = std::min(componentRow[i], other[i]);
+                    }
+                    for (uint32_t k = flat.type2NextOffsets[member]; k < flat.type2NextOffsets[member + 1]; k++)
+                    {
+                        if (component[flat.type2NextNodes[k]] == numComponents)
+                            continue;
+                        const uint16_t *other = row(flat.type2NextNodes[k]);
+                        for (int i = 0; i < this->numAgents; i++)
+                            componentRow[i] = std::min(componentRow[i], other[i]);
+                    }
+                }
+                for (auto it = first; it != stack.end(); it++)
+                {
+                    std::copy(componentRow.begin(), componentRow.end(), row(*it));
+                }
+                stack.erase(first, stack.end());
+                numComponents++;
+                continue;
+            }
+
+            if (index[next] == -1)
+            {
+                index[next] = low[next] = counter++;
+                stack.push_back(next);
+                onStack[next] = true;
+                frames.push_back(Frame{next, flat.type2NextOffsets[next], false});
+            }
+            else if (onStack[next])
+            {
+                low[node] = std::min(low[node], index[next]);
+            }
+        }
+    }
+    this->built = true;
+    return true;
+}
+
+bool ReachIndex::addEdge(int fromNode, int toNode, CancelToken *cancel)
+{
+    uint32_t polls = 0;
+    // the nodes that reach fromNode now reach what toNode reaches; every agent whose entry drops is
+    // propagated on its own, and only through the predecessors whose entry drops as well
+    std::vector<int> &worklist = this->worklist;
+    for (int agent = 0; agent < this->numAgents; agent++)
+    {
+        uint16_t timeStep = row(toNode)[agent];
+        if (timeStep >= row(fromNode)[agent])
+            continue;
+        row(fromNode)[agent] = timeStep;
+        worklist.assign(1, fromNode);
+        while (!worklist.empty())
+        {
+            if (cancel != nullptr && (cancel->isCancelled() || (++polls % CancelToken::pollInterval == 0 && cancel->expired())))
+            {
+                clear();
+                return false;
+            }
+            int node = worklist.back();
+            worklist.pop_back();
+            auto lower = [&](int pred)
+            {
+                uint16_t &entry = row(pred)[agent];
+                if (entry > timeStep)
+                {
+                    entry = timeStep;
+                    worklist.push_back(pred);
+                }
+            };
+            if (this->flat->timeSteps[node] > 0)
+                lower(node - 1);
+            for (uint32_t k = this->flat->type2InOffsets[node]; k < this->flat->type2InOffsets[node + 1]; k++)
+                lower(this->flat->type2InNodes[k]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,143 @@
+#include "SearchStats.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+// the most expensive checks kept in the report
+static const size_t costliestKept = 16;
+
+void SearchReport::Histogram::add(uint64_t value)
+{
+    size_t bucket = 0;
+    for (uint64_t v = value; v != 0; v >>= 1)
+        bucket++;
+    if (this->buckets.size() <= bucket)
+        this->buckets.resize(bucket + 1, 0);
+    this->buckets[bucket]++;
+    this->total += value;
+    this->max = std::max(this->max, value);
+}
+
+void SearchReport::Histogram::merge(const Histogram &other)
+{
+    if (this->buckets.size() < other.buckets.size())
+        this->buckets.resize(other.buckets.size(), 0);
+    for (size_t i = 0; i < other.buckets.size(); i++)
+        this->buckets[i] += other.buckets[i];
+    this->total += other.total;
+    this->max = std::max(this->max, other.max);
+}
+
+void SearchReport::record(int edgeId, int fromId, int toId, bool valid, const SearchStats &stats)
+{
+    this->searched++;
+    if (stats.exhausted)
+        this->exhausted++;
+    if (valid)
+        this->valid++;
+    this->expanded.add(stats.expanded);
+    this->probed.add(stats.probed);
+    this->revisits.add(stats.revisits);
+    this->maxDepth.add(stats.maxDepth);
+    this->micros.add(stats.micros);
+
+    if (this->costliest.size() == costliestKept && this->costliest.back().stats.expanded >= stats.expanded)
+        return;
+    Candidate candidate{edgeId, fromId, toId, stats};
+    auto position = std::upper_bound(this->costliest.begin(), this->costliest.end(), candidate,
+                                     [](const Candidate &a, const Candidate &b)
+                                     { return a.stats.expanded > b.stats.expanded; });
+    this->costliest.insert(position, candidate);
+    if (this->costliest.size() > costliestKept)
+        this->costliest.pop_back();
+}
+
+void SearchReport::merge(const SearchReport &other, const std::vector<int> &edgeIds, const std::vector<int> &robotIds)
+{
+    this->searched += other.searched;
+    this->unreachable += other.unreachable;
+    this->settled += other.settled;
+    this->exhausted += other.exhausted;
+    this->valid += other.valid;
+    this->cancelled += other.cancelled;
+    this->expanded.merge(other.expanded);
+    this->probed.merge(other.probed);
+    this->revisits.merge(other.revisits);
+    this->maxDepth.merge(other.maxDepth);
+    this->micros.merge(other.micros);
+
+    for (auto &candidate : other.costliest)
+    {
+        this->costliest.push_back(Candidate{edgeIds[candidate.edgeId], robotIds[candidate.fromId], robotIds[candidate.toId], candidate.stats});
+    }
+    std::stable_sort(this->costliest.begin(), this->costliest.end(), [](const Candidate &a, const Candidate &b)
+                     { return a.stats.expanded > b.stats.expanded; });
+    if (this->costliest.size() > costliestKept)
+        this->costliest.resize(costliestKept);
+}
+
+void SearchReport::print(std::ostream &out) const
+{
+    out << "******** BTPG Search Info ********" << std::endl;
+    out << "Searched: " << this->searched << ", valid: " << this->valid << ", over budget: " << this->exhausted << std::endl;
+    out << "Skipped by the reach index: " << this->unreachable << ", settled: " << this->settled << ", cancelled: " << this->cancelled << std::endl;
+    auto line = [&](const char *name, const Histogram &histogram)
+    {
+        out << name << ": total " << histogram.total << ", max " << histogram.max << ", log2 buckets";
+        for (auto &count : histogram.buckets)
+            out << " " << count;
+        out << std::endl;
+    };
+    line("Expanded nodes", this->expanded);
+    line("Frontier nodes", this->probed);
+    line("Revisit insertions", this->revisits);
+    line("Max depth", this->maxDepth);
+    line("Time (us)", this->micros);
+    for (auto &candidate : this->costliest)
+    {
+        out << "Edge " << candidate.edgeId << " (" << candidate.fromId << " -> " << candidate.toId << "): " << candidate.stats.expanded
+            << " expanded, " << candidate.stats.micros << " us" << (candidate.stats.exhausted ? ", over budget" : "") << std::endl;
+    }
+    out << "******** ***** ********" << std::endl;
+}
+
+bool SearchReport::writeJson(std::string fileName) const
+{
+    std::ofstream out(fileName);
+    if (!out)
+        return false;
+    auto histogram = [&](const char *name, const Histogram &histogram)
+    {
+        out << "  \"" << name << "\": {\"total\": " << histogram.total << ", \"max\": " << histogram.max << ", \"log2Buckets\": [";
+        for (size_t i = 0; i < histogram.buckets.size(); i++)
+            out << (i == 0 ? "" : ", ") << histogram.buckets[i];
+        out << "]}," << std::endl;
+    };
+    out << "{" << std::endl;
+    out << "  \"searched\": " << this->searched << "," << std::endl;
+    out << "  \"valid\": " << this->valid << "," << std::endl;
+    out << "  \"overBudget\": " << this->exhausted << "," << std::endl;
+    out << "  \"unreachable\": " << this->unreachable << "," << std::endl;
+    out << "  \"settled\": " << this->settled << "," << std::endl;
+    out << "  \"cancelled\": " << this->cancelled << "," << std::endl;
+    histogram("expanded", this->expanded);
+    histogram("probed", this->probed);
+    histogram("revisits", this->revisits);
+    histogram("maxDepth", this->maxDepth);
+    histogram("micros", this->micros);
+    out << "  \"costliest\": [";
+    for (size_t i = 0; i < this->costliest.size(); i++)
+    {
+        const Candidate &candidate = this->costliest[i];
+        out << (i == 0 ? "" : ",") << std::endl;
+        out << "    {\"edgeId\": " << candidate.edgeId << ", \"fromId\": " << candidate.fromId << ", \"toId\": " << candidate.toId
+            << ", \"expanded\": " << candidate.stats.expanded << ", \"probed\": " << candidate.stats.probed << ", \"revisits\": " << candidate.stats.revisits
+            << ", \"maxDepth\": " << candidate.stats.maxDepth << ", \"micros\": " << candidate.stats.micros
+            << ", \"overBudget\": " << (candidate.stats.exhausted ? "true" : "false") << "}";
+    }
+    out << std::endl
+        << "  ]" << std::endl;
+    out << "}" << std::endl;
+    out.close();
+    return !out.fail();
+}
@@ -23,7 +23,16 @@ int Sim::Simulate(BTPG *btpg_)
 {
     this->mode = 1;
     this->btpg = btpg_;
+    this->flat = &this->btpg->getFlatGraph();
     srand(this->seed);
+    // a resumed BTPG may be simulated again
+    for (int i = 0; i < this->btpg->getNumBiPairs(); ++i)
+        this->btpg->getBiPair(i)->isVisited = false;
+    for (int i = 0; i < this->btpg->getNumBiGroupPairs(); ++i)
+    {
+        this->btpg->getBiGroupPair(i)->isVisited = false;
+        this->btpg->getBiGroupPair(i)->claimedBy = -1;
+    }
     // 1a. Initialize generated Path
     for (int i = 0; i < this->btpg->getNumAgents(); ++i)
     {
@@ -94,6 +103,7 @@ int Sim::Simulate(TPG *tpg_)
 {
     this->mode = 0;
     this->tpg = tpg_;
+    this->flat = &this->tpg->getFlatGraph();
     srand(this->seed);
     // 1a. Initialize generated Path
     for (int i = 0; i < this->tpg->getNumAgents(); ++i)
@@ -166,6 +176,7 @@ void Sim::SimulateNoDelay(TPG *tpg_)
 
     this->mode = 0;
     this->tpg = tpg_;
+    this->flat = &this->tpg->getFlatGraph();
     srand(this->seed);
     // 1a. Initialize generated Path
     for (int i = 0; i < this->tpg->getNumAgents(); ++i)
@@ -289,11 +300,7 @@ void Sim::CheckTPGWoDelayPathValidity()
     for (int i = 0; i < this->TPGGeneratedPathNoDelay.size(); i++)
     {
         // find the start and end coord from TPG
-        Node *node = this->tpg->getAgent(i)->Type1Next;
-        while (node->Type1Next != NULL)
-        {
-            node = node->Type1Next;
-        }
+        Node *node = this->tpg->getNode(i, this->tpg->getAgent(i)->pathLength - 1);
         Coord endCoord = node->coord;
         Coord startCoord = this->tpg->getAgent(i)->Type1Next->coord;
         if (this->TPGGeneratedPathNoDelay[i][0] != startCoord || this->TPGGeneratedPathNoDelay[i][this->TPGGeneratedPathNoDelay[i].size() - 1] != endCoord)
@@ -344,11 +351,7 @@ void Sim::CheckTPGPathValidity()
     for (int i = 0; i < TPGGeneratedPath.size(); i++)
     {
         // find the start and end coord from TPG
-        Node *node = this->tpg->getAgent(i)->Type1Next;
-        while (node->Type1Next != NULL)
-        {
-            node = node->Type1Next;
-        }
+        Node *node = this->tpg->getNode(i, this->tpg->getAgent(i)->pathLength - 1);
         Coord endCoord = node->coord;
         Coord startCoord = this->tpg->getAgent(i)->Type1Next->coord;
         if (TPGGeneratedPath[i][0] != startCoord || TPGGeneratedPath[i][TPGGeneratedPath[i].size() - 1] != endCoord)
@@ -401,11 +404,7 @@ void Sim::CheckBTPGPathValidity()
     for (int i = 0; i < BTPGGeneratedPath.size(); i++)
     {
         // find the start and end coord from TPG
-        Node *node = this->btpg->getAgent(i)->Type1Next;
-        while (node->Type1Next != NULL)
-        {
-            node = node->Type1Next;
-        }
+        Node *node = this->btpg->getNode(i, this->btpg->getAgent(i)->pathLength - 1);
         Coord endCoord = node->coord;
         Coord startCoord = this->btpg->getAgent(i)->Type1Next->coord;
         if (BTPGGeneratedPath[i][0] != startCoord || BTPGGeneratedPath[i][BTPGGeneratedPath[i].size() - 1] != endCoord)
@@ -450,6 +449,7 @@ void Sim::CheckBTPGPathValidity()
 }
 void Sim::SimulateTimeStep(std::vector<int> &movableAgents, std::vector<std::vector<bool>> &visited, std::vector<bool> &finishedAgent)
 {
+    const FlatGraph &flat = *this->flat;
 
     // 1. Check which agent can move based on BTPG
     int NumRobotsCanMoveBasedOnBTPG = 0;
@@ -470,16 +470,27 @@ void Sim::SimulateTimeStep(std::vector<int> &movableAgents, std::vector<std::vec
             if (finishedAgent[i])
                 continue;
             int BTPGNextIdx = std::find(visited[i].begin(), visited[i].end(), false) - visited[i].begin();
-            Node *BTPGNextNode = this->btpg->getAgent(i)->Type1Next;
-            for (int j = 0; j < BTPGNextIdx; ++j)
-            {
-                BTPGNextNode = BTPGNextNode->Type1Next;
-            }
+            Node *BTPGNextNode = this->btpg->getNode(i, BTPGNextIdx);
             bool CanVisit = true;
             std::vector<int> CheckBiPair;
-            for (auto edge : BTPGNextNode->Type2Prev)
+            std::vector<int> CheckBiGroupPair;
+            for (uint32_t k = flat.type2PrevOffsets[BTPGNextNode->nodeId]; k < flat.type2PrevOffsets[BTPGNextNode->nodeId + 1]; k++)
             {
-                if (this->mode == 1 && edge->isBidirectional)
+                type2Edge *edge = this->btpg->getTypeTwoEdge(flat.type2PrevEdges[k]);
+                int fromNode = flat.type2PrevNodes[k];
+                // the first agent through a reversed group claims all of its edges, which then bind only the other agent
+                if (this->mode == 1 && edge->isGroupedBidirectional)
+                {
+                    BiGroupPair *biGroupPair = this->btpg->getBiGroupPair(edge->biGroupId);
+                    if (!biGroupPair->isVisited)
+                    {
+                        CheckBiGroupPair.push_back(edge->biGroupId);
+                        continue;
+                    }
+                    if (biGroupPair->claimedBy == i)
+                        continue;
+                }
+                else if (this->mode == 1 && edge->isBidirectional)
                 {
                     if (!this->btpg->getBiPair(edge->biPairId)->isVisited)
                     {
@@ -487,10 +498,10 @@ void Sim::SimulateTimeStep(std::vector<int> &movableAgents, std::vector<std::vec
                         continue;
                     }
                 }
-                if (visited[edge->nodeFrom->robotId][edge->nodeFrom->timeStep] == false)
+                if (visited[flat.robotIds[fromNode]][flat.timeSteps[fromNode]] == false)
                 {
                     CanVisit = false;
-                    BTPGrotationStopRobots.push_back(std::make_pair(std::make_pair(i, BTPGNextIdx), std::make_pair(edge->nodeFrom->robotId, edge->nodeFrom->timeStep)));
+                    BTPGrotationStopRobots.push_back(std::make_pair(std::make_pair(i, BTPGNextIdx), std::make_pair(flat.robotIds[fromNode], flat.timeSteps[fromNode])));
                     tempCheckMoveAgents.push_back(i);
                     break;
                 }
@@ -517,6 +528,18 @@ void Sim::SimulateTimeStep(std::vector<int> &movableAgents, std::vector<std::vec
                         }
                         this->btpg->getBiPair(biPairId)->isVisited = true;
                     }
+                    for (auto biGroupId : CheckBiGroupPair)
+                    {
+                        BiGroupPair *biGroupPair = this->btpg->getBiGroupPair(biGroupId);
+                        if (biGroupPair->isVisited)
+                            continue;
+                        if (this->btpg->getType2EdgeGroup(biGroupPair->originalId)->toId == i)
+                        {
+                            this->numBidirectionalEdgesIsUsed++;
+                        }
+                        biGroupPair->isVisited = true;
+                        biGroupPair->claimedBy = i;
+                    }
                 }
 
             }
@@ -539,6 +562,7 @@ void Sim::SimulateTimeStep(std::vector<int> &movableAgents, std::vector<std::vec
 
 void Sim::SimulateTPGTimeStep(std::vector<int> &movableAgents, std::vector<std::vector<bool>> &visited, std::vector<bool> &finishedAgent)
 {
+    const FlatGraph &flat = *this->flat;
 
     // 1. Check which agent can move based on TPG
     int NumRobotsCanMoveBasedOnTPG = 0;
@@ -559,20 +583,17 @@ void Sim::SimulateTPGTimeStep(std::vector<int> &movableAgents, std::vector<std::
             if (finishedAgent[i])
                 continue;
             int TPGNextIdx = std::find(visited[i].begin(), visited[i].end(), false) - visited[i].begin();
-            Node *TPGNextNode = this->tpg->getAgent(i)->Type1Next;
-            for (int j = 0; j < TPGNextIdx; ++j)
-            {
-                TPGNextNode = TPGNextNode->Type1Next;
-            }
+            Node *TPGNextNode = this->tpg->getNode(i, TPGNextIdx);
             bool CanVisit = true;
 
-            for (auto edge : TPGNextNode->Type2Prev)
+            for (uint32_t k = flat.type2PrevOffsets[TPGNextNode->nodeId]; k < flat.type2PrevOffsets[TPGNextNode->nodeId + 1]; k++)
             {
+                int fromNode = flat.type2PrevNodes[k];
 
-                if (visited[edge->nodeFrom->robotId][edge->nodeFrom->timeStep] == false)
+                if (visited[flat.robotIds[fromNode]][flat.timeSteps[fromNode]] == false)
                 {
                     CanVisit = false;
-                    TPGrotationStopRobots.push_back(std::make_pair(std::make_pair(i, TPGNextIdx), std::make_pair(edge->nodeFrom->robotId, edge->nodeFrom->timeStep)));
+                    TPGrotationStopRobots.push_back(std::make_pair(std::make_pair(i, TPGNextIdx), std::make_pair(flat.robotIds[fromNode], flat.timeSteps[fromNode])));
                     tempCheckMoveAgents.push_back(i);
                     break;
                 }
@@ -625,6 +646,7 @@ void Sim::SimulateTPGTimeStep(std::vector<int> &movableAgents, std::vector<std::
 
 void Sim::SimulateTPGWoDelayTimeStep(std::vector<int> &movableAgents, std::vector<std::vector<bool>> &visited, std::vector<bool> &finishedAgent)
 {
+    const FlatGraph &flat = *this->flat;
 
     // 1. Check which agent can move based on TPG
     int NumRobotsCanMoveBasedOnTPG = 0;
@@ -645,20 +667,17 @@ void Sim::SimulateTPGWoDelayTimeStep(std::vector<int> &movableAgents, std::vecto
             if (finishedAgent[i])
                 continue;
             int TPGNextIdx = std::find(visited[i].begin(), visited[i].end(), false) - visited[i].begin();
-            Node *TPGNextNode = this->tpg->getAgent(i)->Type1Next;
-            for (int j = 0; j < TPGNextIdx; ++j)
-            {
-                TPGNextNode = TPGNextNode->Type1Next;
-            }
+            Node *TPGNextNode = this->tpg->getNode(i, TPGNextIdx);
             bool CanVisit = true;
 
-            for (auto edge : TPGNextNode->Type2Prev)
+            for (uint32_t k = flat.type2PrevOffsets[TPGNextNode->nodeId]; k < flat.type2PrevOffsets[TPGNextNode->nodeId + 1]; k++)
             {
+                int fromNode = flat.type2PrevNodes[k];
 
-                if (visited[edge->nodeFrom->robotId][edge->nodeFrom->timeStep] == false)
+                if (visited[flat.robotIds[fromNode]][flat.timeSteps[fromNode]] == false)
                 {
                     CanVisit = false;
-                    TPGrotationStopRobots.push_back(std::make_pair(std::make_pair(i, TPGNextIdx), std::make_pair(edge->nodeFrom->robotId, edge->nodeFrom->timeStep)));
+                    TPGrotationStopRobots.push_back(std::make_pair(std::make_pair(i, TPGNextIdx), std::make_pair(flat.robotIds[fromNode], flat.timeSteps[fromNode])));
                     tempCheckMoveAgents.push_back(i);
                     break;
                 }
@@ -694,6 +713,7 @@ void Sim::SimulateTPGWoDelayTimeStep(std::vector<int> &movableAgents, std::vecto
 
 int Sim::moveRotation(std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> &BTPGrotationStopRobots_, std::vector<int> &movableAgents, std::vector<std::vector<bool>> &visited, std::vector<bool> &finishedAgent, int &NumRobotsCanMoveBasedOnBTPG, std::vector<int> &tempCheckMoveAgents)
 {
+    const FlatGraph &flat = *this->flat;
     int canvisit = 0;
     for (auto pair = BTPGrotationStopRobots_.begin(); pair != BTPGrotationStopRobots_.end(); pair++)
     {
@@ -747,29 +767,39 @@ int Sim::moveRotation(std::vector<std::pair<std::pair<int, int>, std::pair<int,
         {
             bool canVisit = true;
             std::vector<int> CheckBiPair;
+            std::vector<std::pair<int, int>> CheckBiGroupPair; ///< groups and the rotating agent that claims them
             for (auto p : toVisitBTPGwithGroupsRotation)
             {
                 // check whether they have other constraints
 
                 int id = p.first;
                 int timeStep = p.second;
-                Node *nodeBTPG = this->btpg->getAgent(id)->Type1Next;
-                for (int j = 0; j < timeStep; j++)
-                {
-                    nodeBTPG = nodeBTPG->Type1Next;
-                }
+                Node *nodeBTPG = this->btpg->getNode(id, timeStep);
 
-                for (auto edge : nodeBTPG->Type2Prev)
+                for (uint32_t k = flat.type2PrevOffsets[nodeBTPG->nodeId]; k < flat.type2PrevOffsets[nodeBTPG->nodeId + 1]; k++)
                 {
-                    int robotId = edge->nodeFrom->robotId;
-                    int time_ = edge->nodeFrom->timeStep;
+                    type2Edge *edge = this->btpg->getTypeTwoEdge(flat.type2PrevEdges[k]);
+                    int fromNode = flat.type2PrevNodes[k];
+                    int robotId = flat.robotIds[fromNode];
+                    int time_ = flat.timeSteps[fromNode];
 
                     if (std::find(toVisitBTPGwithGroupsRotation.begin(), toVisitBTPGwithGroupsRotation.end(), std::make_pair(robotId, time_)) != toVisitBTPGwithGroupsRotation.end())
                     {
                         continue;
                     }
 
-                    if (this->mode == 1 && edge->isBidirectional)
+                    if (this->mode == 1 && edge->isGroupedBidirectional)
+                    {
+                        BiGroupPair *biGroupPair = this->btpg->getBiGroupPair(edge->biGroupId);
+                        if (!biGroupPair->isVisited)
+                        {
+                            CheckBiGroupPair.push_back(std::make_pair(edge->biGroupId, id));
+                            continue;
+                        }
+                        if (biGroupPair->claimedBy == id)
+                            continue;
+                    }
+                    else if (this->mode == 1 && edge->isBidirectional)
                     {
                         if (!this->btpg->getBiPair(edge->biPairId)->isVisited)
                         {
@@ -820,16 +850,20 @@ int Sim::moveRotation(std::vector<std::pair<std::pair<int, int>, std::pair<int,
                             finishedAgent[id] = true;
                             this->btpg->getAgent(id)->BTPGFinishedTime = this->BTPGTotalTimeStep;
                         }
-                        Node *nodeBTPG = this->btpg->getAgent(id)->Type1Next;
-                        for (int j = 0; j < nextIdx; j++)
-                        {
-                            nodeBTPG = nodeBTPG->Type1Next;
-                        }
+                        Node *nodeBTPG = this->btpg->getNode(id, nextIdx);
                         this->BTPGGeneratedPath[id].push_back(nodeBTPG->coord);
                         for (auto biPairId : CheckBiPair)
                         {
                             this->btpg->getBiPair(biPairId)->isVisited = true;
                         }
+                        for (auto &claim : CheckBiGroupPair)
+                        {
+                            BiGroupPair *biGroupPair = this->btpg->getBiGroupPair(claim.first);
+                            if (biGroupPair->isVisited)
+                                continue;
+                            biGroupPair->isVisited = true;
+                            biGroupPair->claimedBy = claim.second;
+                        }
                     }
                 }
             }
@@ -843,6 +877,7 @@ int Sim::moveRotation(std::vector<std::pair<std::pair<int, int>, std::pair<int,
 
 int Sim::moveTPGRotation(std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> &TPGrotationStopRobots_, std::vector<int> &movableAgents, std::vector<std::vector<bool>> &visited, std::vector<bool> &finishedAgent, int &NumRobotsCanMoveBasedOnTPG, std::vector<int> &tempCheckMoveAgents)
 {
+    const FlatGraph &flat = *this->flat;
     int canvisit = 0;
     for (auto pair = TPGrotationStopRobots_.begin(); pair != TPGrotationStopRobots_.end(); pair++)
     {
@@ -901,17 +936,14 @@ int Sim::moveTPGRotation(std::vector<std::pair<std::pair<int, int>, std::pair<in
 
                 int id = p.first;
                 int timeStep = p.second;
-                Node *nodeTPG = this->tpg->getAgent(id)->Type1Next;
-                for (int j = 0; j < timeStep; j++)
-                {
-                    nodeTPG = nodeTPG->Type1Next;
-                }
+                Node *nodeTPG = this->tpg->getNode(id, timeStep);
 
-                for (auto edge : nodeTPG->Type2Prev)
+                for (uint32_t k = flat.type2PrevOffsets[nodeTPG->nodeId]; k < flat.type2PrevOffsets[nodeTPG->nodeId + 1]; k++)
                 {
+                    int fromNode = flat.type2PrevNodes[k];
 
-                    int robotId = edge->nodeFrom->robotId;
-                    int time_ = edge->nodeFrom->timeStep;
+                    int robotId = flat.robotIds[fromNode];
+                    int time_ = flat.timeSteps[fromNode];
                     // check this robotId and time_ is in the toVisitTPGwithGroupsRotation
                     if (std::find(toVisitTPGwithGroupsRotation.begin(), toVisitTPGwithGroupsRotation.end(), std::make_pair(robotId, time_)) != toVisitTPGwithGroupsRotation.end())
                     {
@@ -960,11 +992,7 @@ int Sim::moveTPGRotation(std::vector<std::pair<std::pair<int, int>, std::pair<in
                             finishedAgent[id] = true;
                             this->tpg->getAgent(id)->TPGFinishedTime = this->TPGTotalTimeStep;
                         }
-                        Node *node = this->tpg->getAgent(id)->Type1Next;
-                        for (int j = 0; j < nextIdx; j++)
-                        {
-                            node = node->Type1Next;
-                        }
+                        Node *node = this->tpg->getNode(id, nextIdx);
                         this->TPGGeneratedPath[id].push_back(node->coord);
                     }
                 }
@@ -979,6 +1007,7 @@ int Sim::moveTPGRotation(std::vector<std::pair<std::pair<int, int>, std::pair<in
 
 int Sim::moveTPGWoDelayRotation(std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> &TPGrotationStopRobots_, std::vector<int> &movableAgents, std::vector<std::vector<bool>> &visited, std::vector<bool> &finishedAgent, int &NumRobotsCanMoveBasedOnTPG, std::vector<int> &tempCheckMoveAgents)
 {
+    const FlatGraph &flat = *this->flat;
     int canvisit = 0;
     for (auto pair = TPGrotationStopRobots_.begin(); pair != TPGrotationStopRobots_.end(); pair++)
     {
@@ -1037,16 +1066,13 @@ int Sim::moveTPGWoDelayRotation(std::vector<std::pair<std::pair<int, int>, std::
 
                 int id = p.first;
                 int timeStep = p.second;
-                Node *nodeTPG = this->tpg->getAgent(id)->Type1Next;
-                for (int j = 0; j < timeStep; j++)
-                {
-                    nodeTPG = nodeTPG->Type1Next;
-                }
+                Node *nodeTPG = this->tpg->getNode(id, timeStep);
 
-                for (auto edge : nodeTPG->Type2Prev)
+                for (uint32_t k = flat.type2PrevOffsets[nodeTPG->nodeId]; k < flat.type2PrevOffsets[nodeTPG->nodeId + 1]; k++)
                 {
-                    int robotId = edge->nodeFrom->robotId;
-                    int time_ = edge->nodeFrom->timeStep;
+                    int fromNode = flat.type2PrevNodes[k];
+                    int robotId = flat.robotIds[fromNode];
+                    int time_ = flat.timeSteps[fromNode];
 
                     if (std::find(toVisitTPGwithGroupsRotation.begin(), toVisitTPGwithGroupsRotation.end(), std::make_pair(robotId, time_)) != toVisitTPGwithGroupsRotation.end())
                     {
@@ -1084,11 +1110,7 @@ int Sim::moveTPGWoDelayRotation(std::vector<std::pair<std::pair<int, int>, std::
                             finishedAgent[id] = true;
                             this->tpg->getAgent(id)->TPGFinishedTimeNoDelay = this->TPGTotalTimeStepNoDelay;
                         }
-                        Node *node = this->tpg->getAgent(id)->Type1Next;
-                        for (int j = 0; j < nextIdx; j++)
-                        {
-                            node = node->Type1Next;
-                        }
+                        Node *node = this->tpg->getNode(id, nextIdx);
                         this->TPGGeneratedPathNoDelay[id].push_back(node->coord);
                     }
                 }
@@ -1,100 +1,848 @@
 #include <TPG.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// binary plan format (native byte order):
+//   char[8]  magic "BTPGPLAN"
+//   uint32   version
+//   uint32   number of agents
+//   uint32   path length of every agent
+//   uint16   (x, y) of every step, agent after agent
+static const char binaryPlanMagic[8] = {'B', 'T', 'P', 'G', 'P', 'L', 'A', 'N'};
+static const uint32_t binaryPlanVersion = 1;
+
+// parse a (possibly negative) decimal integer, advancing p past its digits
+static inline bool parseInt(const char *&p, const char *end, int &value)
+{
+    bool negative = false;
+    if (p < end && *p == '-')
+    {
+        negative = true;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+    int result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+// constructor of an empty TPG, filled with appendAgentPath
+TPG::TPG()
+{
+    this->numAgents = 0;
+    this->numTypeTwoEdges = 0;
+    this->reduced = false;
+    this->loaded = true;
+    this->flatGraph.agentOffsets.push_back(0);
+    this->flatGraphDirty = true;
+    this->componentsDirty = true;
+}
 
 // constructor of TPG
-TPG::TPG(std::string fileName)
+TPG::TPG(std::string fileName, int numThreads, bool reduced)
 {
     this->numAgents = 0;
     this->numTypeTwoEdges = 0;
-    // read the file
-    std::ifstream file(fileName);
-    std::string line;
+    this->reduced = reduced;
+    this->flatGraph.agentOffsets.push_back(0);
+    this->flatGraphDirty = true;
+    this->componentsDirty = true;
 
 #ifdef DEBUG
     std::cout << "Start reading the file" << std::endl;
 #endif
-    while (std::getline(file, line))
+    // a plan that cannot be read leaves the TPG unloaded, which the caller checks
+    this->loaded = readPlan(fileName);
+    if (!this->loaded)
+        return;
+#ifdef DEBUG
+    std::cout << "Finish reading the file" << std::endl;
+#endif
+    indexCellVisits();
+
+    // Collect type-2 edges per agent, in parallel when asked to
+    std::vector<std::vector<std::pair<Node *, Node *>>> agentEdges(getNumAgents());
+    if (numThreads <= 1)
+    {
+        for (int i = 0; i < getNumAgents(); i++)
+        {
+            collectTypeTwoEdges(getAgent(i), agentEdges[i]);
+        }
+    }
+    else
+    {
+        std::atomic<int> nextAgent(0);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < numThreads; t++)
+        {
+            workers.emplace_back([&]()
+                                 {
+                int i;
+                while ((i = nextAgent.fetch_add(1)) < getNumAgents())
+                {
+                    collectTypeTwoEdges(getAgent(i), agentEdges[i]);
+                } });
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    // Add type-2 edges to TPGs, merging in agent order so edge ids do not depend on the thread count
+    for (auto &edges : agentEdges)
     {
-        size_t pos = line.find(':');
-        line.erase(0, pos + 2);
-        std::string delimiter = "->";
-        pos = 0;
-        std::string token;
+        for (auto &edge : edges)
+        {
+            connectTypeTwoEdge(edge.first, edge.second);
+        }
+    }
+#ifdef DEBUG
+    std::cout << "Finish adding type-2 edges" << std::endl;
+    std::cout << "******** TPG INFO ********" << std::endl;
+    std::cout << "Number of agents: " << getNumAgents() << std::endl;
+    std::cout << "Number of type-2 edges: " << getNumTypeTwoEdges() << std::endl;
+#endif
+}
 
-        Agent *agent = new Agent();
+// append a step at the end of the path of an agent
+Node *TPG::addPathNode(Agent *agent, Node *prev, int x, int y)
+{
+    Node *newNode = this->arena.nodes.create(x, y);
+    newNode->robotId = agent->robotId;
+    newNode->timeStep = agent->pathLength;
+    newNode->nodeId = this->flatGraph.nodes.size();
+    this->flatGraph.nodes.push_back(newNode);
+    this->flatGraph.robotIds.push_back(newNode->robotId);
+    this->flatGraph.timeSteps.push_back(newNode->timeStep);
+    if (prev == NULL)
+    {
+        agent->Type1Next = newNode;
+    }
+    else
+    {
+        prev->Type1Next = newNode;
+        newNode->Type1Prev = prev;
+    }
+    agent->pathLength++;
+    return newNode;
+}
+
+// parse plan lines of the form "Agent N: (x,y)->(x,y)->..." in a single pass
+bool TPG::parseTextPlan(const char *data, size_t size)
+{
+    const char *p = data;
+    const char *end = data + size;
+    int lineNumber = 0;
+    while (p < end)
+    {
+        const char *lineEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (lineEnd == NULL)
+            lineEnd = end;
+        lineNumber++;
+        const char *colon = static_cast<const char *>(memchr(p, ':', lineEnd - p));
+        if (colon == NULL)
+        {
+            p = lineEnd + 1;
+            continue;
+        }
+        p = colon + 1;
+
+        Agent *agent = this->arena.agents.create();
         Node *prev = NULL;
-        int timeStep = 0;
         agent->robotId = getNumAgents();
 
-        while ((pos = line.find(delimiter)) != std::string::npos)
+        // every "(x,y)" token followed by "->" is a step of the path
+        while (p < lineEnd)
         {
-            token = line.substr(0, pos);
-            token.erase(0, 1);                  // Erase the first character
-            token.erase(token.length() - 1, 1); // Erase the last character
+            while (p < lineEnd && *p != '(')
+                p++;
+            if (p >= lineEnd)
+                break;
+            p++;
+            int xCoord, yCoord;
+            if (!parseInt(p, lineEnd, xCoord) || p >= lineEnd || *p != ',')
+                break;
+            p++;
+            if (!parseInt(p, lineEnd, yCoord) || p >= lineEnd || *p != ')')
+                break;
+            p++;
+            if (lineEnd - p < 2 || p[0] != '-' || p[1] != '>')
+                break;
+            p += 2;
+
+            prev = addPathNode(agent, prev, xCoord, yCoord);
+        }
+        // an agent without a step is not a plan line, and would leave an empty path in the graph
+        if (prev == NULL)
+        {
+            std::cerr << "Malformed plan line " << lineNumber << std::endl;
+            return false;
+        }
+        addRobot(agent);
+        p = lineEnd + 1;
+    }
+    return true;
+}
 
-            int xCoord = std::stoi(token.substr(0, token.find(',')));
-            int yCoord = std::stoi(token.substr(token.find(',') + 1));
-            Node *newNode = new Node(xCoord, yCoord);
-            newNode->robotId = agent->robotId;
-            newNode->timeStep = timeStep;
-            if (prev == NULL)
+// load a plan stored in the binary format written by writeBinaryPlan
+bool TPG::loadBinaryPlan(const char *data, size_t size)
+{
+    const char *p = data + sizeof(binaryPlanMagic);
+    const char *end = data + size;
+    uint32_t version, numPlanAgents;
+    if (end - p < (ptrdiff_t)(2 * sizeof(uint32_t)))
+    {
+        std::cerr << "Truncated binary plan header" << std::endl;
+        return false;
+    }
+    memcpy(&version, p, sizeof(uint32_t));
+    memcpy(&numPlanAgents, p + sizeof(uint32_t), sizeof(uint32_t));
+    p += 2 * sizeof(uint32_t);
+    if (version != binaryPlanVersion)
+    {
+        std::cerr << "Unsupported binary plan version: " << version << std::endl;
+        return false;
+    }
+    if ((size_t)(end - p) < numPlanAgents * sizeof(uint32_t))
+    {
+        std::cerr << "Truncated binary plan" << std::endl;
+        return false;
+    }
+    std::vector<uint32_t> pathLengths(numPlanAgents);
+    memcpy(pathLengths.data(), p, numPlanAgents * sizeof(uint32_t));
+    p += numPlanAgents * sizeof(uint32_t);
+    size_t numSteps = 0;
+    for (auto length : pathLengths)
+        numSteps += length;
+    if ((size_t)(end - p) < numSteps * 2 * sizeof(uint16_t))
+    {
+        std::cerr << "Truncated binary plan" << std::endl;
+        return false;
+    }
+
+    // the sizes are known up front, so the agents and nodes are written straight into one block each
+    Agent *agentBlock = this->arena.agents.createBlock(numPlanAgents);
+    Node *nodeBlock = this->arena.nodes.createBlock(numSteps);
+    FlatGraph &flat = this->flatGraph;
+    flat.nodes.reserve(flat.nodes.size() + numSteps);
+    flat.robotIds.reserve(flat.robotIds.size() + numSteps);
+    flat.timeSteps.reserve(flat.timeSteps.size() + numSteps);
+    Node *node = nodeBlock;
+    for (uint32_t i = 0; i < numPlanAgents; i++)
+    {
+        Agent *agent = agentBlock + i;
+        uint32_t length = pathLengths[i];
+        agent->robotId = getNumAgents();
+        agent->pathLength = length;
+        agent->Type1Next = length > 0 ? node : NULL;
+        for (uint32_t t = 0; t < length; t++, node++)
+        {
+            uint16_t xy[2];
+            memcpy(xy, p, sizeof(xy));
+            p += sizeof(xy);
+            node->coord = Coord(xy[0], xy[1]);
+            node->robotId = agent->robotId;
+            node->timeStep = t;
+            node->nodeId = flat.nodes.size();
+            node->Type1Prev = t > 0 ? node - 1 : NULL;
+            node->Type1Next = t + 1 < length ? node + 1 : NULL;
+            flat.nodes.push_back(node);
+            flat.robotIds.push_back(node->robotId);
+            flat.timeSteps.push_back(node->timeStep);
+        }
+        addRobot(agent);
+    }
+    return true;
+}
+
+// read the paths of a plan, text or binary, without building its type-2 edges
+bool TPG::readPlan(std::string fileName)
+{
+    // map the file and parse it in place
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat fileStat;
+    bool read = false;
+    if (fd < 0 || fstat(fd, &fileStat) != 0)
+    {
+        std::cerr << "Cannot open the file: " << fileName << std::endl;
+    }
+    else if (fileStat.st_size > 0)
+    {
+        void *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            std::cerr << "Cannot map the file: " << fileName << std::endl;
+        }
+        else
+        {
+            madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+            if (fileStat.st_size >= (off_t)sizeof(binaryPlanMagic) && memcmp(data, binaryPlanMagic, sizeof(binaryPlanMagic)) == 0)
             {
-                agent->Type1Next = newNode;
-                agent->pathLength++;
+                read = loadBinaryPlan(static_cast<const char *>(data), fileStat.st_size);
             }
             else
             {
-                prev->Type1Next = newNode;
-                newNode->Type1Prev = prev;
-                agent->pathLength++;
+                read = parseTextPlan(static_cast<const char *>(data), fileStat.st_size);
             }
-            prev = newNode;
-            timeStep++;
-
-            line.erase(0, pos + delimiter.length());
+            munmap(data, fileStat.st_size);
         }
-        addRobot(agent);
     }
-#ifdef DEBUG
-    std::cout << "Finish reading the file" << std::endl;
-#endif
-    // Add type-2 edges to TPGs
+    if (fd >= 0)
+        close(fd);
+    return read;
+}
+
+// convert a plan into the binary plan format; only the paths are needed, so no type-2 edge is built
+int TPG::convertPlan(std::string planFile, std::string binaryFile)
+{
+    TPG tpg;
+    if (!tpg.readPlan(planFile) || !tpg.writeBinaryPlan(binaryFile))
+        return -1;
+    return tpg.getNumAgents();
+}
+
+// write the agent paths in the binary plan format
+bool TPG::writeBinaryPlan(std::string fileName)
+{
+    std::vector<uint32_t> pathLengths;
+    std::vector<uint16_t> coords;
     for (auto &agent : this->agents)
     {
-        int robotId = agent->robotId;
+        pathLengths.push_back(agent->pathLength);
         Node *node = agent->Type1Next;
         while (node != NULL)
         {
-            int currentTimeStep = node->timeStep;
-            for (auto &otherAgent : this->agents)
+            if (node->coord.x < 0 || node->coord.x > UINT16_MAX || node->coord.y < 0 || node->coord.y > UINT16_MAX)
             {
-                if (otherAgent->robotId != robotId)
-                {
-                    Node *otherNode = otherAgent->Type1Next;
-                    while (otherNode != NULL)
-                    {
-                        if (otherNode->coord == node->coord && otherNode->timeStep > currentTimeStep)
-                        {
-                            type2Edge *newType2Edge = new type2Edge();
-                            newType2Edge->nodeFrom = node->Type1Next;
-                            newType2Edge->nodeTo = otherNode;
-                            newType2Edge->edgeId = getNumTypeTwoEdges();
-                            addTypeTwoEdge(newType2Edge);
-                            node->Type1Next->Type2Next.push_back(newType2Edge);
-                            otherNode->Type2Prev.push_back(newType2Edge);
-                        }
-                        otherNode = otherNode->Type1Next;
-                    }
-                }
+                std::cerr << "Coordinate out of range for the binary plan format: " << *node << std::endl;
+                return false;
             }
+            coords.push_back(node->coord.x);
+            coords.push_back(node->coord.y);
             node = node->Type1Next;
         }
     }
-#ifdef DEBUG
-    std::cout << "Finish adding type-2 edges" << std::endl;
-    std::cout << "******** TPG INFO ********" << std::endl;
-    std::cout << "Number of agents: " << getNumAgents() << std::endl;
-    std::cout << "Number of type-2 edges: " << getNumTypeTwoEdges() << std::endl;
-#endif
+
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Cannot open the file: " << fileName << std::endl;
+        return false;
+    }
+    uint32_t version = binaryPlanVersion;
+    uint32_t numPlanAgents = pathLengths.size();
+    file.write(binaryPlanMagic, sizeof(binaryPlanMagic));
+    file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char *>(&numPlanAgents), sizeof(numPlanAgents));
+    file.write(reinterpret_cast<const char *>(pathLengths.data()), pathLengths.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char *>(coords.data()), coords.size() * sizeof(uint16_t));
+    return file.good();
+}
+
+// index the visits of every cell, sorted by time step
+void TPG::indexCellVisits()
+{
+    this->cellVisits.clear();
+    for (auto &agent : this->agents)
+    {
+        Node *node = agent->Type1Next;
+        while (node != NULL)
+        {
+            this->cellVisits[node->coord].push_back(node);
+            node = node->Type1Next;
+        }
+    }
+    for (auto &cell : this->cellVisits)
+    {
+        std::stable_sort(cell.second.begin(), cell.second.end(), [](Node *a, Node *b)
+                         { return a->timeStep < b->timeStep; });
+    }
+}
+
+// collect the (from, to) nodes of the type-2 edges leaving the path of an agent
+void TPG::collectTypeTwoEdges(Agent *agent, std::vector<std::pair<Node *, Node *>> &edges)
+{
+    int robotId = agent->robotId;
+    Node *node = agent->Type1Next;
+    std::vector<Node *> laterVisits;
+    while (node != NULL && node->Type1Next != NULL)
+    {
+        int currentTimeStep = node->timeStep;
+        // later visits of the same cell by other agents
+        const std::vector<Node *> &visits = this->cellVisits.at(node->coord);
+        auto it = std::upper_bound(visits.begin(), visits.end(), currentTimeStep, [](int timeStep, Node *other)
+                                   { return timeStep < other->timeStep; });
+        laterVisits.clear();
+        if (this->reduced)
+        {
+            // only the next visit: later ones are reached through it
+            if (it != visits.end() && (*it)->robotId != robotId)
+                laterVisits.push_back(*it);
+        }
+        else
+        {
+            for (; it != visits.end(); it++)
+            {
+                if ((*it)->robotId != robotId)
+                    laterVisits.push_back(*it);
+            }
+        }
+        // keep the edge order of the agent-by-agent scan
+        std::sort(laterVisits.begin(), laterVisits.end(), [](Node *a, Node *b)
+                  { return a->robotId != b->robotId ? a->robotId < b->robotId : a->timeStep < b->timeStep; });
+        for (auto &otherNode : laterVisits)
+        {
+            edges.push_back(std::make_pair(node->Type1Next, otherNode));
+        }
+        node = node->Type1Next;
+    }
+}
+
+// create a type-2 edge and link it into the adjacency of both nodes
+type2Edge *TPG::connectTypeTwoEdge(Node *nodeFrom, Node *nodeTo)
+{
+    type2Edge *newType2Edge = this->arena.type2Edges.create();
+    newType2Edge->nodeFrom = nodeFrom;
+    newType2Edge->nodeTo = nodeTo;
+    newType2Edge->edgeId = getNumTypeTwoEdges();
+    addTypeTwoEdge(newType2Edge);
+    linkTypeTwoEdge(newType2Edge, nodeFrom, nodeTo);
+    return newType2Edge;
+}
+
+// add an edge to the outgoing edges of a node and the incoming edges of another; the CSR arrays get it when next read
+void TPG::linkTypeTwoEdge(type2Edge *edge, Node *nextOf, Node *prevOf)
+{
+    this->flatGraph.linkType2Edge(edge->edgeId, nextOf->nodeId, prevOf->nodeId);
+}
+
+// append the path of a new agent and connect it to the agents already in the TPG
+int TPG::appendAgentPath(const std::vector<Coord> &path)
+{
+    Agent *agent = this->arena.agents.create();
+    Node *prev = NULL;
+    agent->robotId = getNumAgents();
+    for (auto &coord : path)
+    {
+        prev = addPathNode(agent, prev, coord.x, coord.y);
+    }
+    addRobot(agent);
+
+    // index the new visits, keeping every cell sorted by time step
+    Node *node = agent->Type1Next;
+    while (node != NULL)
+    {
+        std::vector<Node *> &visits = this->cellVisits[node->coord];
+        auto it = std::upper_bound(visits.begin(), visits.end(), node->timeStep, [](int timeStep, Node *other)
+                                   { return timeStep < other->timeStep; });
+        visits.insert(it, node);
+        node = node->Type1Next;
+    }
+
+    // only the cells of the new path can hold new conflicts
+    std::vector<std::pair<Node *, Node *>> edges;
+    node = agent->Type1Next;
+    while (node != NULL)
+    {
+        std::vector<Node *> &visits = this->cellVisits[node->coord];
+        if (this->reduced)
+        {
+            // only the neighbouring visits of the cell
+            auto it = std::find(visits.begin(), visits.end(), node);
+            if (it != visits.begin() && (*(it - 1))->robotId != agent->robotId && (*(it - 1))->Type1Next != NULL)
+                edges.push_back(std::make_pair((*(it - 1))->Type1Next, node));
+            if (it + 1 != visits.end() && (*(it + 1))->robotId != agent->robotId && node->Type1Next != NULL)
+                edges.push_back(std::make_pair(node->Type1Next, *(it + 1)));
+        }
+        else
+        {
+            for (auto &other : visits)
+            {
+                if (other->robotId == agent->robotId)
+                    continue;
+                if (other->timeStep > node->timeStep && node->Type1Next != NULL)
+                    edges.push_back(std::make_pair(node->Type1Next, other));
+                else if (other->timeStep < node->timeStep && other->Type1Next != NULL)
+                    edges.push_back(std::make_pair(other->Type1Next, node));
+            }
+        }
+        node = node->Type1Next;
+    }
+
+    // add the new edges in the order of the full construction
+    std::sort(edges.begin(), edges.end(), [](const std::pair<Node *, Node *> &a, const std::pair<Node *, Node *> &b)
+              {
+        if (a.first->robotId != b.first->robotId)
+            return a.first->robotId < b.first->robotId;
+        if (a.first->timeStep != b.first->timeStep)
+            return a.first->timeStep < b.first->timeStep;
+        if (a.second->robotId != b.second->robotId)
+            return a.second->robotId < b.second->robotId;
+        return a.second->timeStep < b.second->timeStep; });
+    for (auto &edge : edges)
+    {
+        connectTypeTwoEdge(edge.first, edge.second);
+    }
+    return agent->robotId;
+}
+
+// sweep the visits of a cell after visits[first] in time order, following type-1 edges and the one-way type-2 edges of the cell;
+// every visit of another agent not ordered after visits[first] this way, nor joined to it by a bidirectional edge, is passed
+// to unordered, which returns true if it ordered it
+void TPG::sweepCellVisits(const std::vector<Node *> &visits, size_t first, const std::function<bool(size_t)> &unordered)
+{
+    // 0: not ordered, 1: ordered, 2: joined to visits[first] by a bidirectional edge
+    std::vector<uint8_t> order(visits.size() - first, 0);
+    std::vector<int> orderedAgents; ///< agents with an ordered visit, whose later visits follow it
+    auto mark = [&](size_t c, type2Edge *edge)
+    {
+        // reversed edges are linked at the same nodes as the edges of the cell
+        if (edge->nodeTo->coord != visits[c]->coord)
+            return;
+        auto it = std::lower_bound(visits.begin() + c + 1, visits.end(), edge->nodeTo->timeStep, [](Node *other, int timeStep)
+                                   { return other->timeStep < timeStep; });
+        if (it == visits.end() || *it != edge->nodeTo)
+            return;
+        uint8_t &o = order[it - visits.begin() - first];
+        if (!edge->isBidirectional)
+            o = 1;
+        else if (o == 0)
+            o = 2;
+    };
+    std::vector<type2Edge *> edges;
+    if (visits[first]->Type1Next != NULL)
+    {
+        findType2Next(visits[first]->Type1Next->nodeId, edges);
+        for (auto &edge : edges)
+        {
+            if (edge->isBidirectional)
+                mark(first, edge);
+        }
+    }
+    order[0] = 1;
+    for (size_t c = first; c < visits.size(); c++)
+    {
+        Node *visit = visits[c];
+        bool agentOrdered = std::find(orderedAgents.begin(), orderedAgents.end(), visit->robotId) != orderedAgents.end();
+        if (order[c - first] != 1 && !agentOrdered && (order[c - first] == 2 || !unordered(c)))
+            continue;
+        if (!agentOrdered)
+            orderedAgents.push_back(visit->robotId);
+        if (visit->Type1Next == NULL)
+            continue;
+        // bidirectional edges order nothing
+        findType2Next(visit->Type1Next->nodeId, edges);
+        for (auto &edge : edges)
+        {
+            if (!edge->isBidirectional)
+                mark(c, edge);
+        }
+    }
+}
+
+// in a reduced TPG, the visits of a cell are only ordered through the chain of edges between consecutive visits;
+// once an edge of the chain becomes bidirectional, every order that went through it is made explicit
+void TPG::connectBypassEdges(type2Edge *edge)
+{
+    if (!this->reduced)
+        return;
+    Node *fromVisit = edge->nodeFrom->Type1Prev;
+    Node *toVisit = edge->nodeTo;
+    std::vector<Node *> &visits = this->cellVisits[toVisit->coord];
+    auto fromIt = std::find(visits.begin(), visits.end(), fromVisit);
+    auto toIt = std::find(visits.begin(), visits.end(), toVisit);
+    if (fromIt == visits.end() || toIt == visits.end())
+        return;
+    size_t from = fromIt - visits.begin();
+    size_t to = toIt - visits.begin();
+
+    // only the orders from a visit up to fromVisit to a visit from toVisit on could go through the edge;
+    // the later visits first, so the earlier ones are ordered through their new edges where they can
+    for (size_t a = from + 1; a-- > 0;)
+    {
+        if (visits[a]->Type1Next == NULL)
+            continue;
+        sweepCellVisits(visits, a, [&](size_t b)
+                        {
+            if (b < to || (a == from && b == to))
+                return false;
+            connectTypeTwoEdge(visits[a]->Type1Next, visits[b]);
+            return true; });
+    }
+}
+
+// check that every two visits of a cell by different agents are still ordered as in the TPG, unless their own edge is bidirectional
+bool TPG::checkVisitOrders()
+{
+    int numUnordered = 0;
+    for (auto &cell : this->cellVisits)
+    {
+        std::vector<Node *> &visits = cell.second;
+        for (size_t a = 0; a < visits.size(); a++)
+        {
+            // the last visit of an agent has no type-2 edge to order it before the others
+            if (visits[a]->Type1Next == NULL)
+                continue;
+            sweepCellVisits(visits, a, [&](size_t b)
+                            {
+                std::cerr << "Unordered visits of " << cell.first.x << "," << cell.first.y << ": agent " << visits[a]->robotId << " at "
+                          << visits[a]->timeStep << " and agent " << visits[b]->robotId << " at " << visits[b]->timeStep << std::endl;
+                numUnordered++;
+                return false; });
+        }
+    }
+    return numUnordered == 0;
+}
+
+bool TPG::isReduced()
+{
+    return this->reduced;
+}
+
+bool TPG::isLoaded()
+{
+    return this->loaded;
+}
+
+// write the paths and the type-2 edges, including where each edge is linked
+void TPG::saveGraph(std::ostream &out)
+{
+    writeBinary(out, (uint8_t)this->reduced);
+    writeBinary(out, (uint32_t)getNumAgents());
+    for (auto &agent : this->agents)
+    {
+        writeBinary(out, (uint32_t)agent->pathLength);
+        for (Node *node = agent->Type1Next; node != NULL; node = node->Type1Next)
+        {
+            writeBinary(out, (int32_t)node->coord.x);
+            writeBinary(out, (int32_t)node->coord.y);
+        }
+    }
+
+    writeBinary(out, (uint32_t)getNumTypeTwoEdges());
+    for (auto &edge : this->type2Edges)
+    {
+        writeBinary(out, (int32_t)edge->nodeFrom->nodeId);
+        writeBinary(out, (int32_t)edge->nodeTo->nodeId);
+        writeBinary(out, this->flatGraph.type2NextOf[edge->edgeId]);
+        writeBinary(out, this->flatGraph.type2PrevOf[edge->edgeId]);
+        writeBinary(out, (int32_t)edge->biPairId);
+        writeBinary(out, (int32_t)edge->groupId);
+        writeBinary(out, (int32_t)edge->biGroupId);
+        uint8_t flags = (edge->isBidirectional ? 1 : 0) | (edge->isGroupedBidirectional ? 2 : 0) | (edge->isGrouped ? 4 : 0);
+        writeBinary(out, flags);
+    }
+}
+
+// read the graph written by saveGraph into an empty TPG
+bool TPG::loadGraph(std::istream &in)
+{
+    uint8_t reducedFlag;
+    uint32_t numPlanAgents;
+    if (!readBinary(in, reducedFlag) || !readBinary(in, numPlanAgents))
+        return false;
+    this->reduced = reducedFlag != 0;
+    for (uint32_t i = 0; i < numPlanAgents; i++)
+    {
+        uint32_t length;
+        if (!readBinary(in, length))
+            return false;
+        Agent *agent = this->arena.agents.create();
+        Node *prev = NULL;
+        agent->robotId = getNumAgents();
+        for (uint32_t t = 0; t < length; t++)
+        {
+            int32_t x, y;
+            if (!readBinary(in, x) || !readBinary(in, y))
+                return false;
+            prev = addPathNode(agent, prev, x, y);
+        }
+        addRobot(agent);
+    }
+
+    uint32_t numEdges;
+    if (!readBinary(in, numEdges))
+        return false;
+    int numNodes = this->flatGraph.getNumNodes();
+    for (uint32_t e = 0; e < numEdges; e++)
+    {
+        int32_t nodeFrom, nodeTo, nextOf, prevOf, biPairId, groupId, biGroupId;
+        uint8_t flags;
+        if (!readBinary(in, nodeFrom) || !readBinary(in, nodeTo) || !readBinary(in, nextOf) || !readBinary(in, prevOf) ||
+            !readBinary(in, biPairId) || !readBinary(in, groupId) || !readBinary(in, biGroupId) || !readBinary(in, flags))
+            return false;
+        if (nodeFrom < 0 || nodeFrom >= numNodes || nodeTo < 0 || nodeTo >= numNodes || nextOf >= numNodes || prevOf >= numNodes)
+            return false;
+        type2Edge *edge = this->arena.type2Edges.create();
+        edge->nodeFrom = this->flatGraph.nodes[nodeFrom];
+        edge->nodeTo = this->flatGraph.nodes[nodeTo];
+        edge->edgeId = getNumTypeTwoEdges();
+        edge->biPairId = biPairId;
+        edge->groupId = groupId;
+        edge->biGroupId = biGroupId;
+        edge->isBidirectional = flags & 1;
+        edge->isGroupedBidirectional = flags & 2;
+        edge->isGrouped = flags & 4;
+        addTypeTwoEdge(edge);
+        // edges were linked in id order, which keeps the adjacency order
+        if (nextOf >= 0 && prevOf >= 0)
+            linkTypeTwoEdge(edge, this->flatGraph.nodes[nextOf], this->flatGraph.nodes[prevOf]);
+    }
+    indexCellVisits();
+    return true;
+}
+
+// copy the paths and type-2 edges of another TPG into an empty TPG, without parsing its plan again
+void TPG::copyGraph(TPG &other)
+{
+    this->reduced = other.reduced;
+    for (auto &otherAgent : other.agents)
+    {
+        Agent *agent = this->arena.agents.create();
+        Node *prev = NULL;
+        agent->robotId = getNumAgents();
+        for (Node *node = otherAgent->Type1Next; node != NULL; node = node->Type1Next)
+        {
+            prev = addPathNode(agent, prev, node->coord.x, node->coord.y);
+        }
+        addRobot(agent);
+    }
+
+    // reversed edges are not linked at their own end nodes
+    const std::vector<int32_t> &nextOf = other.flatGraph.type2NextOf;
+    const std::vector<int32_t> &prevOf = other.flatGraph.type2PrevOf;
+    const std::vector<Node *> &nodes = this->flatGraph.nodes;
+    this->type2Edges.reserve(other.getNumTypeTwoEdges());
+    for (auto &otherEdge : other.type2Edges)
+    {
+        type2Edge *edge = this->arena.type2Edges.create(*otherEdge);
+        edge->nodeFrom = nodes[otherEdge->nodeFrom->nodeId];
+        edge->nodeTo = nodes[otherEdge->nodeTo->nodeId];
+        addTypeTwoEdge(edge);
+        if (nextOf[edge->edgeId] >= 0 && prevOf[edge->edgeId] >= 0)
+            linkTypeTwoEdge(edge, nodes[nextOf[edge->edgeId]], nodes[prevOf[edge->edgeId]]);
+    }
+    indexCellVisits();
+}
+
+// copy the paths of some agents of another TPG, given in id order, and some type-2 edges between them into an empty TPG;
+// the other TPG has no reversed edge yet, so every edge is linked at its own nodes, in id order
+void TPG::copyAgents(TPG &other, const std::vector<int> &robotIds, const std::vector<int> &edgeIds)
+{
+    this->reduced = other.reduced;
+    for (int robotId : robotIds)
+    {
+        Agent *agent = this->arena.agents.create();
+        Node *prev = NULL;
+        agent->robotId = getNumAgents();
+        for (Node *node = other.agents[robotId]->Type1Next; node != NULL; node = node->Type1Next)
+        {
+            prev = addPathNode(agent, prev, node->coord.x, node->coord.y);
+        }
+        addRobot(agent);
+    }
+
+    // the id of an agent here is its position among the copied agents
+    auto localNode = [&](Node *node)
+    {
+        int localId = std::lower_bound(robotIds.begin(), robotIds.end(), node->robotId) - robotIds.begin();
+        return this->flatGraph.nodes[this->flatGraph.getNodeId(localId, node->timeStep)];
+    };
+    for (int edgeId : edgeIds)
+    {
+        type2Edge *otherEdge = other.type2Edges[edgeId];
+        connectTypeTwoEdge(localNode(otherEdge->nodeFrom), localNode(otherEdge->nodeTo));
+    }
+    indexCellVisits();
+}
+
+// union the agents joined by a type-2 edge; components are numbered in the order of their first agent
+void TPG::findComponents()
+{
+    std::vector<int> parent(getNumAgents());
+    for (int i = 0; i < getNumAgents(); i++)
+    {
+        parent[i] = i;
+    }
+    auto root = [&](int i)
+    {
+        while (parent[i] != i)
+        {
+            i = parent[i] = parent[parent[i]];
+        }
+        return i;
+    };
+    for (auto &edge : this->type2Edges)
+    {
+        int a = root(edge->nodeFrom->robotId);
+        int b = root(edge->nodeTo->robotId);
+        // the smaller id is the root, so every root comes first in its component
+        if (a != b)
+            parent[std::max(a, b)] = std::min(a, b);
+    }
+    this->componentIds.assign(getNumAgents(), -1);
+    this->componentAgents.clear();
+    for (int i = 0; i < getNumAgents(); i++)
+    {
+        int r = root(i);
+        if (r == i)
+        {
+            this->componentIds[i] = this->componentAgents.size();
+            this->componentAgents.emplace_back();
+        }
+        else
+        {
+            this->componentIds[i] = this->componentIds[r];
+        }
+        this->componentAgents[this->componentIds[i]].push_back(i);
+    }
+    this->componentsDirty = false;
+}
+
+int TPG::getNumComponents()
+{
+    if (this->componentsDirty)
+        findComponents();
+    return this->componentAgents.size();
+}
+
+int TPG::getComponentId(int robotId)
+{
+    if (this->componentsDirty)
+        findComponents();
+    return this->componentIds[robotId];
+}
+
+const std::vector<int> &TPG::getComponentAgents(int componentId)
+{
+    if (this->componentsDirty)
+        findComponents();
+    return this->componentAgents[componentId];
+}
+
+// every graph object is owned by the arena and released with it
+TPG::~TPG()
+{
+}
+
+void TPG::printMemoryUsage()
+{
+    this->arena.report(std::cout);
 }
 
 int TPG::getNumAgents()
@@ -106,12 +854,19 @@ void TPG::addRobot(Agent *agent)
 {
     this->numAgents++;
     this->agents.push_back(agent);
+    // the nodes of an agent are created right before it is added
+    this->flatGraph.agentOffsets.push_back(this->flatGraph.nodes.size());
+    this->flatGraphDirty = true;
+    this->componentsDirty = true;
 }
 
 void TPG::addTypeTwoEdge(type2Edge *edge)
 {
     this->numTypeTwoEdges++;
     this->type2Edges.push_back(edge);
+    this->flatGraph.type2NextOf.push_back(-1);
+    this->flatGraph.type2PrevOf.push_back(-1);
+    this->componentsDirty = true;
 }
 
 int TPG::getNumTypeTwoEdges()
@@ -119,6 +874,126 @@ int TPG::getNumTypeTwoEdges()
     return this->numTypeTwoEdges;
 }
 
+Node *TPG::getNode(int robotId, int timeStep)
+{
+    return this->flatGraph.nodes[this->flatGraph.getNodeId(robotId, timeStep)];
+}
+
+// the flat view of the graph, with the CSR arrays brought up to date
+const FlatGraph &TPG::getFlatGraph()
+{
+    if (this->flatGraphDirty)
+    {
+        buildFlatAdjacency();
+        this->flatGraphDirty = false;
+    }
+    else if (this->flatGraph.numMergedEdges < this->flatGraph.type2NextOf.size())
+    {
+        mergeFlatAdjacency();
+    }
+    return this->flatGraph;
+}
+
+// append the edges linked since the CSR arrays were last brought up to date, which have the highest edge ids
+void TPG::mergeFlatAdjacency()
+{
+    FlatGraph &flat = this->flatGraph;
+    std::vector<FlatGraph::Type2Link> next, prev, in;
+    for (uint32_t e = flat.numMergedEdges; e < flat.type2NextOf.size(); e++)
+    {
+        if (flat.type2NextOf[e] < 0)
+            continue;
+        uint32_t from = this->type2Edges[e]->nodeFrom->nodeId;
+        uint32_t to = this->type2Edges[e]->nodeTo->nodeId;
+        next.push_back(FlatGraph::Type2Link{(uint32_t)flat.type2NextOf[e], e, to});
+        prev.push_back(FlatGraph::Type2Link{(uint32_t)flat.type2PrevOf[e], e, from});
+        in.push_back(FlatGraph::Type2Link{to, e, (uint32_t)flat.type2NextOf[e]});
+    }
+    flat.numMergedEdges = flat.type2NextOf.size();
+    flat.appendType2Links(next, prev, in);
+}
+
+// the outgoing type-2 edges of a node, including the ones linked since the CSR arrays were last brought up to date
+void TPG::findType2Next(int nodeId, std::vector<type2Edge *> &edges)
+{
+    if (this->flatGraphDirty)
+        getFlatGraph();
+    const FlatGraph &flat = this->flatGraph;
+    edges.clear();
+    for (uint32_t k = flat.type2NextOffsets[nodeId]; k < flat.type2NextOffsets[nodeId + 1]; k++)
+    {
+        edges.push_back(this->type2Edges[flat.type2NextEdges[k]]);
+    }
+    for (uint32_t e = flat.numMergedEdges; e < flat.type2NextOf.size(); e++)
+    {
+        if (flat.type2NextOf[e] == nodeId)
+            edges.push_back(this->type2Edges[e]);
+    }
+}
+
+// lay out the edges linked at every node in CSR arrays, in edge id order, and invert the outgoing edges
+void TPG::buildFlatAdjacency()
+{
+    FlatGraph &flat = this->flatGraph;
+    int numNodes = flat.getNumNodes();
+    uint32_t numEdges = flat.type2NextOf.size();
+    flat.type2NextOffsets.assign(numNodes + 1, 0);
+    flat.type2PrevOffsets.assign(numNodes + 1, 0);
+    for (uint32_t e = 0; e < numEdges; e++)
+    {
+        if (flat.type2NextOf[e] < 0)
+            continue;
+        flat.type2NextOffsets[flat.type2NextOf[e] + 1]++;
+        flat.type2PrevOffsets[flat.type2PrevOf[e] + 1]++;
+    }
+    for (int n = 0; n < numNodes; n++)
+    {
+        flat.type2NextOffsets[n + 1] += flat.type2NextOffsets[n];
+        flat.type2PrevOffsets[n + 1] += flat.type2PrevOffsets[n];
+    }
+    flat.type2NextEdges.resize(flat.type2NextOffsets[numNodes]);
+    flat.type2NextNodes.resize(flat.type2NextOffsets[numNodes]);
+    flat.type2PrevEdges.resize(flat.type2PrevOffsets[numNodes]);
+    flat.type2PrevNodes.resize(flat.type2PrevOffsets[numNodes]);
+    std::vector<uint32_t> nextFill(flat.type2NextOffsets.begin(), flat.type2NextOffsets.end() - 1);
+    std::vector<uint32_t> prevFill(flat.type2PrevOffsets.begin(), flat.type2PrevOffsets.end() - 1);
+    for (uint32_t e = 0; e < numEdges; e++)
+    {
+        if (flat.type2NextOf[e] < 0)
+            continue;
+        uint32_t next = nextFill[flat.type2NextOf[e]]++;
+        flat.type2NextEdges[next] = e;
+        flat.type2NextNodes[next] = this->type2Edges[e]->nodeTo->nodeId;
+        uint32_t prev = prevFill[flat.type2PrevOf[e]]++;
+        flat.type2PrevEdges[prev] = e;
+        flat.type2PrevNodes[prev] = this->type2Edges[e]->nodeFrom->nodeId;
+    }
+    flat.numMergedEdges = numEdges;
+
+    // invert the outgoing adjacency, keeping the sources of every node in node id order
+    flat.type2InOffsets.assign(numNodes + 1, 0);
+    for (auto &to : flat.type2NextNodes)
+    {
+        flat.type2InOffsets[to + 1]++;
+    }
+    for (int n = 0; n < numNodes; n++)
+    {
+        flat.type2InOffsets[n + 1] += flat.type2InOffsets[n];
+    }
+    flat.type2InEdges.resize(flat.type2NextEdges.size());
+    flat.type2InNodes.resize(flat.type2NextNodes.size());
+    std::vector<uint32_t> fill(flat.type2InOffsets.begin(), flat.type2InOffsets.end() - 1);
+    for (int n = 0; n < numNodes; n++)
+    {
+        for (uint32_t k = flat.type2NextOffsets[n]; k < flat.type2NextOffsets[n + 1]; k++)
+        {
+            uint32_t position = fill[flat.type2NextNodes[k]]++;
+            flat.type2InEdges[position] = flat.type2NextEdges[k];
+            flat.type2InNodes[position] = n;
+        }
+    }
+}
+
 Agent *TPG::getAgent(int robotId)
 {
     return this->agents[robotId];
@@ -128,9 +1003,3 @@ type2Edge *TPG::getTypeTwoEdge(int edgeId)
 {
     return this->type2Edges[edgeId];
 }
-
-void TPG::removeTypeTwoEdge(type2Edge *edge)
-{
-    this->type2Edges.erase(this->type2Edges.begin() + edge->edgeId);
-    this->numTypeTwoEdges--;
-}
\ No newline at end of file
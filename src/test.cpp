@@ -6,11 +6,33 @@
 
 int main(int argc, char *argv[])
 {
+    // convert a text plan into the binary plan format
+    if (argc > 1 && std::string(argv[1]) == "convert")
+    {
+        if (argc != 4)
+        {
+            std::cerr << "Usage: ./btpg convert <textPlan> <binaryPlan>" << std::endl;
+            return 1;
+        }
+        int numConverted = TPG::convertPlan(argv[2], argv[3]);
+        if (numConverted < 0)
+        {
+            return 1;
+        }
+        std::cout << "Converted " << numConverted << " agents to " << argv[3] << std::endl;
+        return 0;
+    }
+
     // read filename from input arg
     std::string filename;
     int seed;
     int algorithmIdx;
     int timeInterval;
+    int numThreads = 1;
+    bool reduced = false;
+    bool printMemory = false;
+    std::string cacheDir;
+    SearchOptions searchOptions;
 
     for (int i = 1; i < argc; ++i)
     {
@@ -19,7 +41,7 @@ int main(int argc, char *argv[])
         // Check for different options
         if (arg == "-h" || arg == "--help")
         {
-            std::cout << "Usage: ./CompareTPGandBTPG -f <filename> -s <seed> -a <algorithmIdx>" << std::endl;
+            std::cout << "Usage: ./CompareTPGandBTPG -f <filename> -s <seed> -a <algorithmIdx> [-t <timeInterval>] [-j <numThreads>] [-r] [-c <cacheDir>] [-b <maxExpansions>] [-p <statsFile>] [-g] [-q] [-u] [-m]" << std::endl;
         }
         else if (arg == "-v" || arg == "--version")
         {
@@ -79,6 +101,79 @@ int main(int argc, char *argv[])
                 return 1;
             }
         }
+        else if (arg == "-j" || arg == "--threads")
+        {
+            if (i + 1 < argc)
+            {
+                numThreads = std::stoi(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "No thread count provided!" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "-c" || arg == "--cache")
+        {
+            if (i + 1 < argc)
+            {
+                cacheDir = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "No cache directory provided!" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "-b" || arg == "--budget")
+        {
+            if (i + 1 < argc)
+            {
+                searchOptions.maxExpansions = std::stoull(argv[i + 1]);
+                ++i;
+            }
+            else
+            {
+                std::cerr << "No expansion budget provided!" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "-p" || arg == "--profile")
+        {
+            if (i + 1 < argc)
+            {
+                searchOptions.collectStats = true;
+                searchOptions.statsFile = argv[i + 1];
+                ++i;
+            }
+            else
+            {
+                std::cerr << "No statistics file provided!" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "-r" || arg == "--reduced")
+        {
+            reduced = true;
+        }
+        else if (arg == "-g" || arg == "--groups")
+        {
+            searchOptions.groupReversal = true;
+        }
+        else if (arg == "-q" || arg == "--prioritize")
+        {
+            searchOptions.prioritize = true;
+        }
+        else if (arg == "-u" || arg == "--give-up")
+        {
+            searchOptions.giveUpCancelled = true;
+        }
+        else if (arg == "-m" || arg == "--memory")
+        {
+            printMemory = true;
+        }
         else
         {
             std::cerr << "Unknown option: " << arg << std::endl;
@@ -87,13 +182,28 @@ int main(int argc, char *argv[])
     }
     int singleTimeInterval = timeInterval;
     bool BTPGFinished = false;
+    TPG *tpg = new TPG(filename, numThreads, reduced);
+    if (!tpg->isLoaded() || tpg->getNumAgents() == 0)
+    {
+        std::cerr << "Cannot read the plan: " << filename << std::endl;
+        delete tpg;
+        return 1;
+    }
+    // the BTPG starts from a copy of the TPG instead of parsing the plan again
+    BTPG *btpg = cacheDir.empty() ? new BTPG(*tpg, algorithmIdx, timeInterval, numThreads, searchOptions)
+                                  : BTPG::loadOrBuild(filename, algorithmIdx, timeInterval, cacheDir, numThreads, reduced, tpg, searchOptions);
+    // TPG *tpg = new TPG("./test/100.txt");
+    // BTPG *btpg = new BTPG("./test/100.txt", 0);
     while (!BTPGFinished)
     {
-        TPG *tpg = new TPG(filename);
-        BTPG *btpg = new BTPG(filename, algorithmIdx, timeInterval);
-        // TPG *tpg = new TPG("./test/100.txt");
-        // BTPG *btpg = new BTPG("./test/100.txt", 0);
-
+        if (printMemory)
+        {
+            btpg->printMemoryUsage();
+        }
+#ifdef DEBUG
+        // the BTPG still orders every two visits of a cell, unless their own edge is bidirectional
+        assert(btpg->checkVisitOrders());
+#endif
         Sim *sim = new Sim(seed, btpg->getNumAgents());
 
         int result = sim->Simulate(tpg);
@@ -104,15 +214,23 @@ int main(int argc, char *argv[])
         // // calculate the statistics
         double improvement = (double)(sim->GetTPGAverageTime() - sim->GetBTPGAverageTime()) / (sim->GetTPGAverageTime() - sim->GetExpectedDelay());
         std::cout << "TPG vs BTPG-o improvement: " << improvement << std::endl;
+        // the improvement after every budget, for comparing the check orders
+        std::cout << "BTPG budget: " << (timeInterval == 0 ? std::string("no limit") : std::to_string(timeInterval) + " ms") << (btpg->finish ? ", finished" : "")
+                  << std::endl;
         if (btpg->finish)
         {
             BTPGFinished = true;
         }
         else
         {
+            // double the total time of the BTPG, continuing the search where it stopped
+            btpg->Resume(timeInterval);
             timeInterval += timeInterval;
         }
+        delete sim;
     }
+    delete btpg;
+    delete tpg;
 
     return 0;
 }
\ No newline at end of file